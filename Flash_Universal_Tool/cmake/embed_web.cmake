@@ -0,0 +1,55 @@
+# Gzip a web asset and emit it as a const C array (lives in flash, served
+# as-is with Content-Encoding: gzip).
+#
+#   cmake -DINPUT=<file> -DOUTPUT=<file.c> -DNAME=<symbol> -DTYPE=<mime> -P embed_web.cmake
+#
+# Runs in script mode at build time, so it needs nothing beyond CMake itself.
+cmake_minimum_required(VERSION 3.19) # file(ARCHIVE_CREATE ... COMPRESSION_LEVEL)
+
+foreach(var INPUT OUTPUT NAME TYPE)
+    if(NOT DEFINED ${var})
+        message(FATAL_ERROR "embed_web.cmake: ${var} not set")
+    endif()
+endforeach()
+
+set(gz "${OUTPUT}.gz")
+get_filename_component(in_name "${INPUT}" NAME)
+file(ARCHIVE_CREATE OUTPUT "${gz}" PATHS "${INPUT}" FORMAT raw
+     COMPRESSION GZip COMPRESSION_LEVEL 9)
+
+file(READ "${gz}" hex HEX)
+file(REMOVE "${gz}")
+
+# Header bytes 4-7 are the archive time. Zero ("not set") keeps the
+# firmware reproducible; ARCHIVE_CREATE only takes MTIME from CMake 3.24.
+string(SUBSTRING "${hex}" 0 8 gz_head)
+string(SUBSTRING "${hex}" 16 -1 gz_rest)
+set(hex "${gz_head}00000000${gz_rest}")
+string(LENGTH "${hex}" hex_len)
+math(EXPR len "${hex_len} / 2")
+file(SIZE "${INPUT}" raw_len)
+
+# Strong ETag from the uncompressed source, so it only changes with the page
+file(SHA1 "${INPUT}" sha)
+string(SUBSTRING "${sha}" 0 16 etag)
+
+string(REGEX REPLACE "([0-9a-f][0-9a-f])" "0x\\1," bytes "${hex}")
+string(REGEX REPLACE "(0x..,0x..,0x..,0x..,0x..,0x..,0x..,0x..,0x..,0x..,0x..,0x..,)"
+       "\\1\n    " bytes "${bytes}")
+
+file(WRITE "${OUTPUT}"
+"// Generated from ${in_name} by cmake/embed_web.cmake - do not edit
+// ${raw_len} bytes -> ${len} bytes gzip
+#include \"web_assets.h\"
+
+static const uint8_t ${NAME}_gz[${len}] = {
+    ${bytes}
+};
+
+const web_asset_t ${NAME} = {
+    .content_type = \"${TYPE}\",
+    .etag = \"\\\"${etag}\\\"\",
+    .data = ${NAME}_gz,
+    .len = sizeof(${NAME}_gz),
+};
+")
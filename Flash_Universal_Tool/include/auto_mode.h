@@ -0,0 +1,54 @@
+#ifndef AUTO_MODE_H
+#define AUTO_MODE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Unattended production mode: wait for a chip, run the pipeline, log the
+// result, wait for removal, repeat. Runs from core1's idle loop.
+
+// Pipeline steps (bitmask), executed in this order
+#define AUTO_STEP_IDENTIFY 0x01 // JEDEC ID valid (and matches, if set)
+#define AUTO_STEP_BLANK 0x02    // Image range must read all 0xFF
+#define AUTO_STEP_HASH 0x04     // Record CRC-32 of the range before programming
+#define AUTO_STEP_PROGRAM 0x08  // Erase + program + page verify from SD image
+#define AUTO_STEP_VERIFY 0x10   // Full read-back CRC must match the image
+
+#define AUTO_DEFAULT_STEPS (AUTO_STEP_IDENTIFY | AUTO_STEP_PROGRAM | AUTO_STEP_VERIFY)
+
+typedef enum {
+    AUTO_OFF = 0,
+    AUTO_WAIT_INSERT, // Polling for a chip
+    AUTO_BUSY,        // Pipeline running
+    AUTO_PASS,        // Last unit passed, waiting for removal
+    AUTO_FAIL,        // Last unit failed, waiting for removal
+} auto_state_t;
+
+typedef struct {
+    uint8_t steps;
+    uint32_t addr;
+    char file[13];
+    uint8_t expect_jedec[3]; // All zero = accept any valid ID
+} auto_config_t;
+
+// Set up locking; call on core0 before core1 is launched
+void auto_mode_init(void);
+
+// Start (or reconfigure) / stop; safe to call from either core
+void auto_mode_start(const auto_config_t *cfg);
+void auto_mode_stop(void);
+void auto_mode_default_config(auto_config_t *cfg);
+
+auto_state_t auto_mode_state(void);
+
+// Parse "identify,blank,program,verify" into a step mask (0 if invalid)
+uint8_t auto_mode_parse_steps(const char *list);
+
+// Status + counters as JSON; returns bytes written
+size_t auto_mode_format_json(char *out, size_t cap);
+
+// Advance the state machine (core1 only)
+void auto_mode_poll(void);
+
+#endif // AUTO_MODE_H
@@ -0,0 +1,41 @@
+#ifndef CBOR_H
+#define CBOR_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "stream_sink.h"
+
+// CBOR (RFC 8949) encoding of the diagnostic report.
+// Same structure as the JSON report, but map keys are the small integers
+// below (one byte each), register values are integers and opcode
+// responses are raw byte strings:
+//   {1:{2:{3:uint,4:text,5:uint,6:uint,7:uint}},
+//    8:[{9:text,10:uint,11:bytes},...]}
+typedef enum {
+    CBOR_KEY_DEVICE = 1,
+    CBOR_KEY_JEDEC = 2,
+    CBOR_KEY_MANUFACTURER_ID = 3,
+    CBOR_KEY_MANUFACTURER_NAME = 4,
+    CBOR_KEY_MEMORY_TYPE = 5,
+    CBOR_KEY_CAPACITY_CODE = 6,
+    CBOR_KEY_CAPACITY_BYTES = 7,
+    CBOR_KEY_COMMANDS = 8,
+    CBOR_KEY_NAME = 9,
+    CBOR_KEY_OPCODE = 10,
+    CBOR_KEY_DATA = 11,
+    CBOR_KEY_ERROR = 12,
+} cbor_report_key_t;
+
+// Stream the report into a sink; false if the sink refused data
+bool cbor_stream_full_report(stream_sink_t *sink, const uint8_t *report_buf,
+                             size_t report_len);
+
+// Encode into a caller buffer; returns bytes written, 0 on error/overflow
+size_t cbor_export_full_report(uint8_t *out_buf, size_t out_cap,
+                               const uint8_t *report_buf, size_t report_len);
+
+// {12:text} (error message), for when there is no sweep to encode
+bool cbor_stream_error(stream_sink_t *sink, const char *message);
+
+#endif
@@ -7,10 +7,84 @@
 #define MQTT_BROKER "broker.hivemq.com"
 #define MQTT_PORT 1883
 #define MQTT_TOPIC "sit/se33/flash/report"
+#define MQTT_TOPIC_CBOR MQTT_TOPIC "/cbor" // Same report, CBOR encoded
+#define MQTT_TOPIC_STATUS "sit/se33/flash/status"
+#define MQTT_TOPIC_CMD "sit/se33/flash/cmd"   // + /<board id> or /all
+#define MQTT_TOPIC_RESP "sit/se33/flash/resp" // + /<board id>
+#define MQTT_CMD_MAX 256                      // Longest command message accepted
+#define MQTT_KEEPALIVE_S 15          // Dead connection noticed after ~1.5x this
+#define MQTT_CONNECT_TIMEOUT_MS 10000 // No CONNACK by then: retry
+#define MQTT_BACKOFF_MIN_MS 1000      // First reconnect delay, doubled per failure
+#define MQTT_BACKOFF_MAX_MS 60000
+#define MQTT_DNS_RETRY_FAILS 3        // Look the broker up again after this many failures
+#define MQTT_OUTBOX_DEPTH 8
+#define MQTT_OUTBOX_PAYLOAD 384
+#define MQTT_CHUNK_SIZE 1024       // Report bytes per message on <topic>/chunk
+#define MQTT_CHUNKS_IN_FLIGHT 4    // Unacknowledged chunks (of MQTT_PUB_WINDOW)
+#define MQTT_PUB_QOS 1             // 1: broker acknowledges every publish (PUBACK)
+#define MQTT_PUB_WINDOW 6          // Unacknowledged publishes; MQTT_REQ_MAX_IN_FLIGHT - 2
+#define MQTT_PUB_RETRIES 3         // Tries per message when there is no SD journal
+#define MQTT_JOURNAL_FILE "mqtt.jnl"   // Offline store-and-forward log on SD
+#define MQTT_JOURNAL_POS "mqtt.pos"    // Its replay position
+#define MQTT_JOURNAL_MAX (512 * 1024)  // Messages past this are dropped
+#define MQTT_REPLAY_WINDOW 3           // Replayed messages unacknowledged at once
+#define MQTT_REPLAY_INTERVAL_MS 20     // Replay pacing (50 messages/s)
 #define HTTP_PORT 80
 #define JSON_BUFFER_SIZE 8192
-#define HTML_BUFFER_SIZE 16384
-#define MAX_HTTP_CONNECTIONS 3
+#define MAX_HTTP_CONNECTIONS 4 // Includes open /api/events streams
+#define HTTP_KEEPALIVE_TIMEOUT_MS 5000 // Idle persistent connection is closed
+#define HTTP_KEEPALIVE_MAX 100         // Requests per connection before close
+#define HTTP_STALL_TIMEOUT_MS 10000    // Half-received request / unACKed stream
+#define HTTP_BUS_QUEUE 2               // Requests parked waiting for a busy flash / SD bus
+#define HTTP_BUS_WAIT_MS 2000          // Longest a parked request waits before 503
+#define HTTP_BUS_RETRY_AFTER_S 2       // Retry-After sent with that 503
+#define WEB_ASSET_MAX_AGE 86400        // Cache lifetime of the embedded UI (s)
+#define HTTP_REQUEST_MAX 2048 // Per-connection request buffer (head + body)
+#define HTTP_RESPONSE_MAX 2048 // Per-connection scratch for in-memory responses
+#define HTTP_STREAM_CHUNK 1460 // Largest streamed piece (one TCP_MSS segment)
+#define DIAG_CACHE_MAX_AGE_MS 30000 // Force a full sweep at least this often
+#define REPORT_FILE_JSON "latest.jsn"
+#define REPORT_FILE_CBOR "latest.cbr"
+
+// core0 main loop: sleeps until a network IRQ, timer or core0_wake()
+#define CORE0_RETRY_MS 5         // Rerun while a request waits on a busy bus / full buffer
+#define STATUS_INTERVAL_MS 60000 // Serial status print
+
+// Background status-register watch (core1, 0 = disabled)
+#define SR_MONITOR_INTERVAL_MS 10
+#define SR_MONITOR_COALESCE_MS 250
+
+// Async jobs (executed on core1)
+#define JOB_SLOTS 4
+#define JOB_CHUNK_SIZE 4096
+#define DUMP_FILE "dump.bin"   // Default SD target for dump jobs
+#define IMAGE_FILE "image.bin" // Default SD source for flash jobs
+
+// Image upload (POST /api/flash) into the flash programming job
+#define UPLOAD_RING_SIZE 8192          // core0 -> core1 buffer; full = TCP window closes
+#define UPLOAD_ERASE_AHEAD (16 * 4096) // Erase at most this far past the write cursor
+#define UPLOAD_STALL_MS 30000          // Job gives up when no data arrives this long
+
+// Web hex viewer (/api/read)
+#define FLASH_READ_MAX 4096     // Largest /api/read page
+#define FLASH_CACHE_SECTORS 4   // 4 KB sectors kept for paging back and forth
+
+// Production-line auto mode
+#define MQTT_TOPIC_UNITS "sit/se33/flash/units"
+#define AUTO_POLL_MS 50         // JEDEC poll period while waiting
+#define AUTO_DEBOUNCE_SAMPLES 3 // Consecutive reads to accept insert/remove
+#define AUTO_LOG_FILE "units.log"
+
+// Live event stream (/api/events, Server-Sent Events)
+#define EVENTS_RING_SLOTS 16       // Shared backlog; slow subscribers skip ahead
+#define EVENTS_DATA_MAX 320        // Largest event payload (a job as JSON)
+#define EVENTS_MAX_SUBSCRIBERS 2   // Open /api/events streams
+#define EVENTS_PROGRESS_MS 250     // Job progress event rate limit
+#define EVENTS_HEARTBEAT_MS 5000   // SSE comment on a quiet stream
+
+// Metrics (/api/metrics, Prometheus text format)
+#define METRICS_SPI_OPCODES 32  // Distinct opcodes counted per core; the rest are "other"
+#define METRICS_HTTP_ROUTES 24  // Route table entries with their own latency histogram
 
 
 #endif
\ No newline at end of file
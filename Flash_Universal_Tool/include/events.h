@@ -0,0 +1,37 @@
+#ifndef EVENTS_H
+#define EVENTS_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "config.h"
+
+// Live events (job progress, status register changes, log lines) for the
+// /api/events Server-Sent Events stream.
+// One small ring shared by every subscriber: producers on either core
+// append and never wait, overwriting the oldest entry. Each subscriber
+// keeps its own cursor, so a slow one only misses events (and is told
+// how many), it never holds up the producer or the other subscribers.
+
+typedef struct {
+    uint32_t seq;                 // Monotonic, doubles as the SSE id
+    char name[12];                // SSE event type: "job", "progress", "sr", "log", ...
+    char data[EVENTS_DATA_MAX];   // One JSON object
+} event_t;
+
+// Call on core0 before core1 is launched
+void events_init(void);
+
+// Append an event; data is a JSON object (truncated events are dropped)
+void events_publish(const char *name, const char *json);
+
+// Log line, published as "log" {"msg":"..."}
+void events_log(const char *fmt, ...) __attribute__((format(printf, 1, 2)));
+
+// Sequence number the next event will get
+uint32_t events_head(void);
+
+// Copy the event at *cursor and advance it. False if the reader is caught
+// up. If the ring lapped the reader, *lost is set to the events skipped.
+bool events_read(uint32_t *cursor, event_t *out, uint32_t *lost);
+
+#endif // EVENTS_H
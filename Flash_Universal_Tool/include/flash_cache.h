@@ -0,0 +1,29 @@
+#ifndef FLASH_CACHE_H
+#define FLASH_CACHE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Small LRU cache of whole target flash sectors for the web hex viewer,
+// so paging back and forth over the same region stays off the SPI bus.
+// Reads come from core0 (lwIP context) only. Invalidation may come from
+// either core: flash_ops does it after every erase / program, and a new
+// JEDEC ID (chip swapped) drops everything.
+
+// Call on core0 before core1 is launched
+void flash_cache_init(void);
+
+// Copy [addr, addr + len) out of the cache, filling missing sectors from
+// the chip. False if a sector could not be read.
+bool flash_cache_read(uint32_t addr, uint8_t *buf, size_t len);
+
+// Forget cached sectors overlapping [addr, addr + len)
+void flash_cache_invalidate(uint32_t addr, uint32_t len);
+
+// Forget everything (different chip, raw opcodes sent)
+void flash_cache_invalidate_all(void);
+
+void flash_cache_stats(uint32_t *hits, uint32_t *misses);
+
+#endif // FLASH_CACHE_H
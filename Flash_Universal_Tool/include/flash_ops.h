@@ -5,6 +5,9 @@
 #include <stdint.h>
 #include <stdbool.h>
 
+#define FLASH_PAGE_SIZE 256
+#define FLASH_SECTOR_SIZE 4096
+
 bool flash_read_bytes(uint32_t address, uint8_t *buffer, size_t size);
 bool flash_erase_sector(uint32_t address);
 bool flash_program_data(uint32_t addr, const uint8_t *data, size_t len);
@@ -14,7 +14,17 @@ extern bool sd_ready;
 extern bool spi_initialized;
 extern uint8_t last_jedec_id[3];
 
-extern mutex_t spi_mutex;
-extern mutex_t buffer_mutex;
+// Recursive so a network handler that already holds one (taken with a
+// try-lock at admission, see web_server.c) can call the normal helpers,
+// which lock again, without blocking
+extern recursive_mutex_t spi_mutex;
+extern recursive_mutex_t buffer_mutex;
+
+// ========== Core0 Wake-up (Defined in main.c) ==========
+
+// Run the core0 service pass (MQTT outbox, live events) soon. Callable
+// from either core or an IRQ; core0 otherwise sleeps until network
+// traffic or a timer.
+void core0_wake(void);
 
 #endif // GLOBALS_H
\ No newline at end of file
@@ -0,0 +1,78 @@
+#ifndef HTTP_PARSER_H
+#define HTTP_PARSER_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "config.h"
+
+// Incremental HTTP/1.1 request parser. Bytes are fed in as they arrive
+// (one pbuf at a time) into a bounded per-connection buffer; once the
+// header block is complete it is split in place into NUL-terminated
+// method / path / query / header strings, parsed exactly once.
+
+#define HTTP_MAX_HEADERS 16
+
+typedef enum {
+    HTTP_PARSE_INCOMPLETE = 0, // Need more bytes
+    HTTP_PARSE_DONE,           // Head (and body, if any) complete
+    HTTP_PARSE_BAD_REQUEST,    // Malformed request line / headers
+    HTTP_PARSE_HEADERS_TOO_LARGE,
+    HTTP_PARSE_BODY_STREAM,    // Head complete; body too big to buffer, left
+                               // unconsumed for the caller (body == NULL)
+} http_parse_status_t;
+
+typedef struct {
+    const char *name;
+    const char *value;
+} http_header_t;
+
+typedef struct {
+    char buf[HTTP_REQUEST_MAX + 1];
+    size_t len;      // Bytes buffered
+    size_t head_len; // Request line + headers incl. blank line, 0 until seen
+
+    // Valid once head_len != 0 (point into buf)
+    const char *method;
+    const char *path;
+    const char *query; // Text after '?', "" if none
+    const char *version;
+    http_header_t headers[HTTP_MAX_HEADERS];
+    uint8_t n_headers;
+
+    size_t content_length;
+    const char *body; // NUL-terminated, content_length bytes once DONE;
+                      // NULL for HTTP_PARSE_BODY_STREAM
+} http_request_t;
+
+// Clear the parser for the next request
+void http_request_reset(http_request_t *req);
+
+// Feed received bytes. *consumed is how many were taken; bytes past the end
+// of this request are left for the caller (next pipelined request).
+http_parse_status_t http_request_feed(http_request_t *req, const void *data,
+                                      size_t len, size_t *consumed);
+
+// Case-insensitive header lookup, NULL if absent
+const char *http_request_header(const http_request_t *req, const char *name);
+
+// Persistent connection wanted? HTTP/1.1 unless "Connection: close",
+// HTTP/1.0 only with "Connection: keep-alive"
+bool http_request_keep_alive(const http_request_t *req);
+
+typedef enum {
+    HTTP_RANGE_NONE = 0,       // No usable Range header: send the whole body
+    HTTP_RANGE_OK,             // *start / *len set
+    HTTP_RANGE_UNSATISFIABLE,  // Starts past the end (416)
+} http_range_t;
+
+// Single "Range: bytes=" range against a body of size bytes. Multiple
+// ranges and malformed headers count as NONE, which RFC 9110 allows.
+http_range_t http_request_range(const http_request_t *req, uint32_t size,
+                                uint32_t *start, uint32_t *len);
+
+// Copy a URL-decoded query parameter; false if missing or it doesn't fit
+bool http_request_query(const http_request_t *req, const char *name, char *out,
+                        size_t cap);
+
+#endif // HTTP_PARSER_H
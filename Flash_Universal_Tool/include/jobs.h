@@ -0,0 +1,73 @@
+#ifndef JOBS_H
+#define JOBS_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Long-running SPI / SD work, submitted from core0 (HTTP) and executed on
+// core1 so the lwIP callbacks never block on the flash chip.
+
+typedef enum {
+    JOB_SCAN = 0, // Safe sweep, refresh diag cache, save JSON + CBOR reports
+    JOB_DUMP,     // Read [addr, addr+len) into an SD file
+    JOB_HASH,     // CRC-32 of [addr, addr+len)
+    JOB_ERASE,    // Erase sectors covering [addr, addr+len)
+    JOB_FLASH,    // Erase + program an SD file at addr, then verify
+    JOB_BLANK,    // Check [addr, addr+len) reads back all 0xFF
+    JOB_UPLOAD,   // Erase + program len bytes of the open HTTP upload at addr
+    JOB_TYPE_COUNT
+} job_type_t;
+
+typedef enum {
+    JOB_FREE = 0,
+    JOB_QUEUED,
+    JOB_RUNNING,
+    JOB_DONE,
+    JOB_FAILED,
+} job_state_t;
+
+typedef struct {
+    uint32_t id;
+    job_type_t type;
+    volatile job_state_t state;
+    uint32_t addr;
+    uint32_t len;           // 0 = whole chip (dump/hash) or whole file (flash)
+    char file[13];          // 8.3 name on SD
+    volatile uint32_t done; // Bytes processed so far
+    uint32_t total;
+    uint32_t crc;           // CRC-32 of the data handled (dump/hash/flash)
+    uint32_t created_ms;
+    uint32_t started_ms;
+    uint32_t finished_ms;
+    char result[128];       // JSON object on success, message on failure
+} job_t;
+
+// Set up the job table; call on core0 before core1 is launched
+void jobs_init(void);
+
+// Parse "scan", "dump", ... Returns JOB_TYPE_COUNT if unknown
+job_type_t job_type_from_name(const char *name);
+const char *job_type_name(job_type_t type);
+
+// Queue a job; returns its id, or 0 if every slot is busy
+uint32_t jobs_submit(job_type_t type, uint32_t addr, uint32_t len,
+                     const char *file);
+
+// Copy out a job by id (consistent snapshot). False if unknown/expired
+bool jobs_get(uint32_t id, job_t *out);
+
+// Write a job as JSON; returns bytes written
+size_t jobs_format_json(const job_t *job, char *out, size_t cap);
+
+// Write every live job as a JSON array; returns bytes written
+size_t jobs_format_list(char *out, size_t cap);
+
+// Run the oldest queued job to completion (core1 only)
+void jobs_poll(void);
+
+// Run a caller-owned job synchronously, bypassing the table (core1 only).
+// Fill type/addr/len/file; result, done and total are filled in.
+bool jobs_run_now(job_t *job);
+
+#endif // JOBS_H
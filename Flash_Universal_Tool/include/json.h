@@ -3,6 +3,8 @@
 
 #include <stddef.h>
 #include <stdint.h>
+#include <stdbool.h>
+#include "stream_sink.h"
 
 // Generate full JSON using safeOps + decoded JEDEC
 // Returns number of bytes written
@@ -10,4 +12,15 @@
 size_t json_export_full_report(char *out_buf, size_t out_cap,
                                const uint8_t *report_buf, size_t report_len);
 
+// Same report, streamed into a sink in small chunks (no full-size buffer)
+// Returns false if the sink refused data part way through
+bool json_stream_full_report(stream_sink_t *sink, const uint8_t *report_buf,
+                             size_t report_len);
+
+// Raw bytes as a JSON array of "XX" strings (read windows, SFDP tables...)
+bool json_stream_hex_array(stream_sink_t *sink, const uint8_t *buf, size_t n);
+
+// Quoted, escaped JSON string
+bool json_stream_string(stream_sink_t *sink, const char *s);
+
 #endif
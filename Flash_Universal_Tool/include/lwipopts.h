@@ -98,7 +98,8 @@
 #define LWIP_SO_RCVTIMEO                1              // Enable receive timeout
 #define LWIP_SO_SNDTIMEO                1              // Enable send timeout
 #define MQTT_OUTPUT_RINGBUF_SIZE        2048            // MQTT output buffer
-#define MQTT_REQ_MAX_IN_FLIGHT          4              // Max in-flight requests
+#define MQTT_REQ_MAX_IN_FLIGHT          8              // Max in-flight requests (QoS 1 window + 2 subscribes)
+#define MQTT_REQ_TIMEOUT                10             // Seconds to wait for a PUBACK / SUBACK
 
 
 // Memory pools for concurrent connections
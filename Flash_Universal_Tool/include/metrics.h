@@ -0,0 +1,67 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "pico/mutex.h"
+#include "stream_sink.h"
+#include "config.h"
+
+// Hot-path counters and latency histograms, exported as Prometheus text
+// on /api/metrics.
+// Every counter exists once per core and is only ever written by its own
+// core, so recording is a few plain increments: no locks, no atomics.
+// The exporter sums both copies when it renders a series.
+
+typedef enum {
+    METRICS_LOCK_SPI = 0,  // spi_mutex
+    METRICS_LOCK_BUFFER,   // buffer_mutex
+    METRICS_LOCK_SD,       // sd_mutex
+    METRICS_LOCK_COUNT,
+} metrics_lock_t;
+
+typedef enum {
+    METRICS_MQTT_OK = 0,
+    METRICS_MQTT_ERROR, // Rejected by the client (not connected, bad args, ...)
+    METRICS_MQTT_RETRY, // Output buffer full, tried again later
+    METRICS_MQTT_COUNT,
+} metrics_mqtt_result_t;
+
+// One SPI transaction (CS low to CS high) on the target flash bus
+void metrics_spi(uint8_t opcode, size_t bytes);
+
+// Drop-in mutex wrappers that record wait and hold times. Nested entries
+// by the holder are neither waits nor separate holds.
+void metrics_lock(recursive_mutex_t *mtx, metrics_lock_t lock);
+bool metrics_try_lock(recursive_mutex_t *mtx, metrics_lock_t lock);
+void metrics_unlock(recursive_mutex_t *mtx, metrics_lock_t lock);
+
+// One disk_read / disk_write call
+void metrics_sd(bool write, uint32_t sectors, uint32_t elapsed_us, bool ok);
+
+void metrics_mqtt(metrics_mqtt_result_t result);
+
+// One publish acknowledged by the broker, elapsed_us after it was sent
+void metrics_mqtt_ack(uint32_t elapsed_us);
+
+// One core0 worker run (event loop wake-up) that took elapsed_us
+void metrics_core0_busy(uint32_t elapsed_us);
+
+// Totals since boot for the status print
+void metrics_core0_stats(uint64_t *busy_us, uint32_t *wakeups);
+
+// Label a route index (0 .. METRICS_HTTP_ROUTES-1) once at startup; the
+// strings must stay valid. Requests that match no route are "other".
+void metrics_http_route(uint8_t route, const char *method, const char *path);
+void metrics_http_request(int route, uint32_t elapsed_us);
+
+// The exposition comes in pieces (a HELP/TYPE header or one whole series)
+// so it can be streamed without tearing a line or holding it all in RAM
+uint32_t metrics_piece_count(void);
+
+// Render one piece; series never recorded write nothing. False if the
+// sink refused data.
+bool metrics_write_piece(stream_sink_t *sink, uint32_t index);
+
+#endif // METRICS_H
@@ -2,13 +2,70 @@
 #define MQTT_OPS_H
 
 #include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
 
-// Initialize the MQTT client and start DNS resolution
+typedef enum {
+    MQTT_STATE_IDLE = 0,
+    MQTT_STATE_RESOLVING,  // DNS lookup of MQTT_BROKER
+    MQTT_STATE_CONNECTING, // TCP + CONNECT sent, no CONNACK yet
+    MQTT_STATE_CONNECTED,
+    MQTT_STATE_BACKOFF,    // Waiting to retry
+} mqtt_conn_state_t;
+
+typedef struct {
+    mqtt_conn_state_t state;
+    uint32_t connects;         // CONNACKs accepted (first connect included)
+    uint32_t connect_failures; // Attempts that didn't get that far
+    uint32_t disconnects;      // Established connections lost
+    uint32_t dns_lookups;
+    uint32_t backoff_ms;       // Last retry delay chosen
+} mqtt_conn_stats_t;
+
+// Initialize the MQTT client and start connecting; it keeps reconnecting
+// (with backoff) on its own after that. Call with the network up.
 void mqtt_init(void);
 
-// Publish a JSON report to the configured topic
-// Returns true if the publish request was queued successfully
-bool mqtt_publish_report(const char *json_data);
+void mqtt_conn_stats(mqtt_conn_stats_t *out);
+
+// Publishes go out at MQTT_PUB_QOS with up to MQTT_PUB_WINDOW of them
+// waiting for the broker's acknowledgement at once (see mqtt.c)
+typedef struct {
+    uint32_t delivered;  // Acknowledged by the broker
+    uint32_t retried;    // Not acknowledged (timeout, connection lost), kept to go again
+    uint32_t dropped;    // Not acknowledged or refused by the client, and given up on
+    uint32_t in_flight;  // Waiting for an acknowledgement now
+    uint64_t ack_us_sum; // Publish to acknowledgement, over all delivered
+    uint32_t ack_us_max;
+} mqtt_delivery_stats_t;
+
+void mqtt_delivery_stats(mqtt_delivery_stats_t *out);
+
+// Publish an SD file (a report) to topic, core0 only. Up to MQTT_CHUNK_SIZE
+// it is one message; larger files go out as numbered, CRC-checked chunks on
+// <topic>/chunk in the background (see mqtt.c). While offline (or while the
+// journal replays) a copy goes into the SD journal instead. False if the
+// file is missing / empty, it couldn't be queued, or another file is still
+// going out. Needs the SD lock held (HTTP bus admission).
+bool mqtt_publish_file(const char *topic, const char *file);
+
+// A file publish is still in progress
+bool mqtt_publish_busy(void);
+
+// Queue a message for publishing from either core
+// Returns false if the outbox is full (message dropped)
+bool mqtt_enqueue(const char *topic, const char *payload);
+
+// Drain the outbox; call from the core0 loop. True if messages are left
+// waiting for room in the client's output buffer (call again soon).
+bool mqtt_service(void);
+
+// Messages that can't be sent right now (offline, failed publish) are kept
+// in an SD journal and replayed in order after reconnecting; see
+// mqtt_journal.h. Without an SD card they wait in the outbox.
+
+// Messages dropped because the outbox was full
+uint32_t mqtt_outbox_drops(void);
 
 // Check current connection status
 bool mqtt_is_connected(void);
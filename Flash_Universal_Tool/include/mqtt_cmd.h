@@ -0,0 +1,32 @@
+#ifndef MQTT_CMD_H
+#define MQTT_CMD_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Remote commands over MQTT. Every device listens on
+// MQTT_TOPIC_CMD/<device id> and on MQTT_TOPIC_CMD/all (whole fleet), for
+// JSON like
+//   {"id":"bench3-17","cmd":"hash","addr":0,"len":65536}
+// cmd is scan, hash, dump (to SD, optional "file") or status. Answers go
+// to MQTT_TOPIC_RESP/<device id> carrying the same "id": "accepted" with
+// the job number right away, then "done" / "failed" with the job result.
+// Only these read-only jobs are offered; erase and flash stay local.
+
+// Work out the device id and topics; call before mqtt connects
+void mqtt_cmd_init(void);
+
+// Board unique id as 16 hex digits
+const char *mqtt_cmd_device_id(void);
+
+// Topic to subscribe to: this device's, or the fleet-wide one
+const char *mqtt_cmd_topic(bool fleet);
+
+// A complete command message arrived (core0, lwIP context)
+void mqtt_cmd_receive(const char *payload, size_t len);
+
+// Publish results of finished command jobs; call from the core0 loop
+void mqtt_cmd_service(void);
+
+#endif // MQTT_CMD_H
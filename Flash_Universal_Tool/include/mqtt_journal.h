@@ -0,0 +1,52 @@
+#ifndef MQTT_JOURNAL_H
+#define MQTT_JOURNAL_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Store-and-forward log for MQTT messages that could not go out (offline,
+// or the publish failed). Records are appended to MQTT_JOURNAL_FILE on SD
+// and replayed in order by mqtt.c after reconnecting; the replay position
+// survives a reboot in MQTT_JOURNAL_POS. Once everything is replayed the
+// file is emptied.
+//
+// Everything except journal_init runs on core0 with the SD lock already
+// held (sd_try_lock or HTTP bus admission), so nothing here waits on it.
+
+typedef struct {
+    char topic[48];
+    uint32_t offset; // File offset of the payload
+    uint32_t len;    // Payload bytes
+    uint32_t next;   // Offset of the following record
+} journal_record_t;
+
+// Scan the journal and load the replay position. Call once after the SD
+// card is mounted (blocking is fine, the network isn't up yet).
+void journal_init(void);
+
+// Append one message; false if there is no SD card or the journal is full
+bool journal_append(const char *topic, const void *data, size_t len);
+
+// Append a copy of a whole file (a report) as one message
+bool journal_append_file(const char *topic, const char *file);
+
+// Header of the record at offset at; false past the last complete record
+bool journal_read(uint32_t at, journal_record_t *rec);
+
+// Read part of a record's payload; bytes read or -1
+int journal_read_payload(uint32_t offset, uint8_t *buf, size_t len);
+
+// First record not yet delivered
+uint32_t journal_cursor(void);
+
+// Records are waiting to be replayed
+bool journal_pending(void);
+
+// The records before cursor (count of them) were delivered: persist the
+// position, and empty the file once nothing is left
+void journal_commit(uint32_t cursor, uint32_t records);
+
+void journal_stats(uint32_t *messages, uint32_t *bytes, uint32_t *drops);
+
+#endif // MQTT_JOURNAL_H
@@ -4,6 +4,8 @@
 
 #include <stdbool.h>
 #include <stddef.h>
+#include <stdint.h>
+#include "stream_sink.h"
 
 // Initialize Hardware, Filesystem, and Mutexes
 bool sd_full_init(void);
@@ -15,6 +17,32 @@ bool sd_is_mounted(void);
 bool sd_write_safe(const char *filename, const char *data);
 bool sd_read_safe(const char *filename, char *buffer, size_t buffer_size);
 
+// Thread-safe binary helpers (one open/close per call)
+bool sd_write_binary_safe(const char *filename, const uint8_t *data, size_t len,
+                          bool append);
+int sd_read_binary_safe(const char *filename, uint32_t offset, uint8_t *buffer,
+                        size_t len);
+int32_t sd_file_size_safe(const char *filename); // -1 if missing
+
+// Streaming sink into a (truncated) file. Holds the SD lock until closed,
+// so only one stream can be open at a time. Returns NULL on failure.
+stream_sink_t *sd_sink_open(const char *filename);
+// Close the stream; false if any write failed
+bool sd_sink_close(stream_sink_t *sink);
+
+// File kept open across writes (a long dump) and locked per write. One at
+// a time; sd_writer_close is needed on every path, and reports whether all
+// the data made it out.
+bool sd_writer_open(const char *filename); // Created / truncated
+bool sd_writer_write(const uint8_t *data, size_t len);
+bool sd_writer_close(void);
+
+// Take the SD lock only if it is free, for callers that must never wait
+// (lwIP callbacks). While held, the *_safe calls above on the same core go
+// straight through.
+bool sd_try_lock(void);
+void sd_unlock(void);
+
 // --- Lower level functions ---
 bool sd_card_init(void);
 bool sd_mount(void);
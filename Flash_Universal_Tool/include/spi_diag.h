@@ -4,8 +4,41 @@
 #include <stddef.h>
 #include <stdint.h>
 #include <stdbool.h>
+#include "stream_sink.h"
 
+// JEDEC ID (3) + SR1 + SR2 + SR3: the leading bytes of the safe sweep,
+// cheap enough to re-read on every request
+#define DIAG_FINGERPRINT_LEN 6
+#define DIAG_REPORT_MAX 64 // Raw safe-sweep bytes kept in the cache
+
+typedef enum {
+    DIAG_ERROR = 0,
+    DIAG_CACHED,  // Report content unchanged since the last refresh
+    DIAG_UPDATED, // Full sweep ran and the report changed
+} diag_status_t;
+
+// Run full SPI diagnostic and generate JSON report (uses the cache)
 bool run_spi_diagnostic(char *json_out, size_t json_cap);
 bool read_jedec_id(uint8_t *mfr, uint8_t *mem_type, uint8_t *capacity);
 
-#endif // SPI_DIAG_H
\ No newline at end of file
+// --- Cached result ---
+// Re-read the fingerprint and only run the full sweep if it changed
+diag_status_t spi_diag_refresh(void);
+// Copy the raw cached sweep (DIAG_REPORT_MAX bytes); 0 if there is none
+size_t spi_diag_snapshot(uint8_t *report);
+// Render the cached sweep as JSON; returns bytes written (0 on error)
+size_t spi_diag_render_json(char *json_out, size_t json_cap);
+// Stream the cached sweep as JSON (error object if there is none)
+bool spi_diag_stream_json(stream_sink_t *sink);
+// Stream the cached sweep as CBOR (see cbor.h for the key map)
+bool spi_diag_stream_cbor(stream_sink_t *sink);
+// Write the cached sweep to SD as REPORT_FILE_JSON and REPORT_FILE_CBOR
+bool spi_diag_save_reports(void);
+// Content hash of the cached sweep, used as the HTTP ETag
+uint32_t spi_diag_etag(void);
+// Fingerprint read that gives up instead of waiting for spi_mutex
+bool spi_diag_try_read_fingerprint(uint8_t *fp);
+// Force the next refresh to run the full sweep
+void spi_diag_invalidate(void);
+
+#endif // SPI_DIAG_H
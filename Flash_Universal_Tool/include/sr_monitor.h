@@ -0,0 +1,17 @@
+#ifndef SR_MONITOR_H
+#define SR_MONITOR_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Background watch of JEDEC ID + SR1..SR3, run from core1's idle loop.
+// Changes are coalesced and published to MQTT_TOPIC_STATUS.
+
+// Sample period in ms (0 disables the monitor)
+void sr_monitor_set_interval(uint32_t interval_ms);
+uint32_t sr_monitor_get_interval(void);
+
+// Take a sample if one is due; cheap to call as often as possible
+void sr_monitor_poll(void);
+
+#endif // SR_MONITOR_H
@@ -0,0 +1,50 @@
+#ifndef STREAM_SINK_H
+#define STREAM_SINK_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Byte sink that report generators write into, a bounded chunk at a time.
+// write() returns false to stop the producer (full, I/O error, no window).
+typedef struct stream_sink {
+    bool (*write)(struct stream_sink *sink, const void *data, size_t len);
+    void *ctx;
+    size_t written; // Total bytes accepted so far
+} stream_sink_t;
+
+// Forward to the sink and keep the byte count
+static inline bool stream_sink_write(stream_sink_t *sink, const void *data,
+                                     size_t len) {
+    if (len == 0) return true;
+    if (!sink->write(sink, data, len)) return false;
+    sink->written += len;
+    return true;
+}
+
+// --- Memory sink: fixed caller buffer, always NUL-terminated ---
+typedef struct {
+    stream_sink_t base;
+    char *buf;
+    size_t cap;
+} mem_sink_t;
+
+void mem_sink_init(mem_sink_t *m, char *buf, size_t cap);
+
+// --- Window sink: keeps bytes [skip, skip + cap) of a stream ---
+// Lets a push-style generator be pulled a piece at a time: re-run it with
+// a growing skip until the window comes back short.
+typedef struct {
+    stream_sink_t base;
+    size_t skip;
+    uint8_t *buf;
+    size_t cap;
+    size_t used; // Bytes captured
+} window_sink_t;
+
+void window_sink_init(window_sink_t *w, size_t skip, uint8_t *buf, size_t cap);
+
+// --- USB / stdio sink ---
+void stdio_sink_init(stream_sink_t *sink);
+
+#endif // STREAM_SINK_H
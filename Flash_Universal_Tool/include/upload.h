@@ -0,0 +1,36 @@
+#ifndef UPLOAD_H
+#define UPLOAD_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Byte stream from an HTTP request body (core0) to the flash programming
+// job (core1). Single producer / single consumer ring of UPLOAD_RING_SIZE:
+// when it is full core0 stops acknowledging TCP data, so the sender is
+// throttled by its receive window rather than by buffering more.
+
+// Call on core0 before core1 is launched
+void upload_init(void);
+
+// Core0: start a stream of len bytes; false if one is already open
+bool upload_open(uint32_t len);
+
+// Core0: copy in as much as fits; returns bytes accepted
+size_t upload_write(const void *data, size_t len);
+
+// Core0: client went away, make the reader give up
+void upload_cancel(void);
+
+// Release the stream: the upload job does this when it ends (core1), or
+// core0 if no job was ever started for it
+void upload_close(void);
+
+// Core1: is there a stream to read?
+bool upload_active(void);
+
+// Core1: copy out exactly n bytes. Returns n, 0 if not all there yet,
+// -1 if the upload was cancelled.
+int upload_read(uint8_t *buf, size_t n);
+
+#endif // UPLOAD_H
@@ -0,0 +1,18 @@
+#ifndef WEB_ASSETS_H
+#define WEB_ASSETS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Static web UI, gzip-compressed at build time (cmake/embed_web.cmake)
+// and linked in as const data, so it stays in flash
+typedef struct {
+    const char *content_type;
+    const char *etag; // Quoted, changes only when the source file does
+    const uint8_t *data;
+    uint32_t len;
+} web_asset_t;
+
+extern const web_asset_t web_index_html;
+
+#endif // WEB_ASSETS_H
@@ -2,9 +2,28 @@
 #define WEB_SERVER_H
 
 #include "lwip/ip_addr.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+// Connection pool usage (all buffers are static, sized from config.h)
+typedef struct {
+    uint8_t in_use;         // Slots holding a connection now
+    uint8_t in_use_peak;
+    uint32_t rejected;      // Connections refused with every slot busy
+    uint16_t request_peak;  // Most bytes buffered for one request (of HTTP_REQUEST_MAX)
+    uint16_t response_peak; // Largest in-memory response body (of HTTP_RESPONSE_MAX)
+} http_pool_stats_t;
 
 // Initialize the HTTP server
 // We pass the current IP address so the HTML can display it
 void http_server_init(const char *ip_address);
 
+// High-water marks of the connection pool
+void http_server_pool_stats(http_pool_stats_t *out);
+
+// Push pending live events to /api/events streams and retry requests
+// waiting on a bus or the upload ring; call from the core0 loop. True if
+// any are still waiting (call again soon).
+bool http_server_service(void);
+
 #endif // WEB_SERVER_H
\ No newline at end of file
@@ -9,6 +9,7 @@
 
 #include "ff.h"     /* Obtains integer types */
 #include "diskio.h" /* Declarations of disk functions */
+#include "metrics.h"
 #include "pico/stdlib.h"
 #include "hardware/spi.h"
 #include "hardware/gpio.h"
@@ -371,7 +372,7 @@ DSTATUS disk_initialize(
 /* Read Sector(s)                                                       */
 /*-----------------------------------------------------------------------*/
 
-DRESULT disk_read(
+static DRESULT read_sectors(
     BYTE pdrv,    /* Physical drive nmuber to identify the drive */
     BYTE *buff,   /* Data buffer to store read data */
     LBA_t sector, /* Start sector in LBA */
@@ -555,13 +556,22 @@ DRESULT disk_read(
     return RES_OK;
 }
 
+// Sector count and latency for /api/metrics
+DRESULT disk_read(BYTE pdrv, BYTE *buff, LBA_t sector, UINT count)
+{
+    uint32_t start = time_us_32();
+    DRESULT res = read_sectors(pdrv, buff, sector, count);
+    metrics_sd(false, count, time_us_32() - start, res == RES_OK);
+    return res;
+}
+
 /*-----------------------------------------------------------------------*/
 /* Write Sector(s)                                                      */
 /*-----------------------------------------------------------------------*/
 
 #if FF_FS_READONLY == 0
 
-DRESULT disk_write(
+static DRESULT write_sectors(
     BYTE pdrv,        /* Physical drive nmuber to identify the drive */
     const BYTE *buff, /* Data to be written */
     LBA_t sector,     /* Start sector in LBA */
@@ -632,6 +642,14 @@ DRESULT disk_write(
     return RES_OK;
 }
 
+DRESULT disk_write(BYTE pdrv, const BYTE *buff, LBA_t sector, UINT count)
+{
+    uint32_t start = time_us_32();
+    DRESULT res = write_sectors(pdrv, buff, sector, count);
+    metrics_sd(true, count, time_us_32() - start, res == RES_OK);
+    return res;
+}
+
 #endif
 
 /*-----------------------------------------------------------------------*/
@@ -0,0 +1,279 @@
+#include "auto_mode.h"
+#include "config.h"
+#include "jobs.h"
+#include "spi_diag.h"
+#include "sd_card.h"
+#include "mqtt.h"
+#include "events.h"
+#include "crc32.h"
+#include "flash_db.h"
+#include "pico/stdlib.h"
+#include "pico/critical_section.h"
+#include <stdio.h>
+#include <string.h>
+
+// ========== Auto Mode State ==========
+// Core0 only posts a new config or a stop request; core1 applies it between
+// units, so a pipeline is never reconfigured halfway through.
+
+static critical_section_t auto_lock;
+static auto_config_t cfg;
+static auto_config_t pending_cfg;
+static volatile bool cfg_pending = false;
+static volatile bool stop_requested = false;
+static volatile auto_state_t state = AUTO_OFF;
+
+static uint32_t next_poll_ms = 0;
+static uint8_t stable_count = 0;
+static uint8_t seen_id[3];
+
+// Image reference, computed once per config
+static int32_t image_len = -1;
+static uint32_t image_crc = 0;
+
+static uint32_t units = 0, passed = 0, failed = 0;
+static char last_result[224] = "";
+
+static const char *const step_names[] = {
+    "identify", "blank", "hash", "program", "verify",
+};
+#define NUM_STEPS (sizeof(step_names) / sizeof(step_names[0]))
+
+void auto_mode_init(void) {
+    critical_section_init(&auto_lock);
+}
+
+void auto_mode_default_config(auto_config_t *c) {
+    memset(c, 0, sizeof(*c));
+    c->steps = AUTO_DEFAULT_STEPS;
+    strncpy(c->file, IMAGE_FILE, sizeof(c->file) - 1);
+}
+
+void auto_mode_start(const auto_config_t *c) {
+    critical_section_enter_blocking(&auto_lock);
+    pending_cfg = *c;
+    cfg_pending = true;
+    stop_requested = false;
+    critical_section_exit(&auto_lock);
+}
+
+void auto_mode_stop(void) {
+    stop_requested = true;
+}
+
+auto_state_t auto_mode_state(void) {
+    return state;
+}
+
+uint8_t auto_mode_parse_steps(const char *list) {
+    uint8_t mask = 0;
+    while (*list) {
+        size_t n = strcspn(list, ",");
+        bool known = false;
+        for (size_t i = 0; i < NUM_STEPS; i++) {
+            if (strlen(step_names[i]) == n && strncmp(list, step_names[i], n) == 0) {
+                mask |= (uint8_t)(1u << i);
+                known = true;
+            }
+        }
+        if (!known) return 0;
+        list += n;
+        if (*list == ',') list++;
+    }
+    return mask;
+}
+
+size_t auto_mode_format_json(char *out, size_t cap) {
+    static const char *const state_names[] = {
+        "off", "waiting", "busy", "pass", "fail",
+    };
+    char steps[48] = "";
+
+    // cfg is replaced under the lock by core1: read all of it in one go
+    critical_section_enter_blocking(&auto_lock);
+    for (size_t i = 0; i < NUM_STEPS; i++) {
+        if (cfg.steps & (1u << i)) {
+            if (steps[0]) strcat(steps, ",");
+            strcat(steps, step_names[i]);
+        }
+    }
+    int n = snprintf(out, cap,
+                     "{\"state\":\"%s\",\"steps\":\"%s\",\"file\":\"%s\",\"addr\":%lu,"
+                     "\"units\":%lu,\"passed\":%lu,\"failed\":%lu,\"last\":%s}",
+                     state_names[state], steps, cfg.file, (unsigned long)cfg.addr,
+                     (unsigned long)units, (unsigned long)passed,
+                     (unsigned long)failed, last_result[0] ? last_result : "null");
+    critical_section_exit(&auto_lock);
+    return (n > 0 && (size_t)n < cap) ? (size_t)n : 0;
+}
+
+// ========== Pipeline (core1) ==========
+
+static bool jedec_present(const uint8_t *id) {
+    return !((id[0] == 0xFF && id[1] == 0xFF && id[2] == 0xFF) ||
+             (id[0] == 0x00 && id[1] == 0x00 && id[2] == 0x00));
+}
+
+// CRC of the reference image, so VERIFY works without a PROGRAM step
+static void load_image_reference(void) {
+    image_len = sd_file_size_safe(cfg.file);
+    image_crc = 0;
+    if (image_len <= 0) return;
+
+    uint8_t buf[512];
+    for (int32_t off = 0; off < image_len; off += sizeof(buf)) {
+        size_t n = (size_t)(image_len - off) < sizeof(buf) ? (size_t)(image_len - off)
+                                                          : sizeof(buf);
+        if (sd_read_binary_safe(cfg.file, (uint32_t)off, buf, n) != (int)n) {
+            image_len = -1;
+            return;
+        }
+        image_crc = crc32_update(image_crc, buf, n);
+    }
+}
+
+static bool run_step(job_type_t type, uint32_t len, job_t *job) {
+    memset(job, 0, sizeof(*job));
+    job->type = type;
+    job->addr = cfg.addr;
+    job->len = len;
+    strncpy(job->file, cfg.file, sizeof(job->file) - 1);
+    return jobs_run_now(job);
+}
+
+static void run_pipeline(const uint8_t *id) {
+    uint32_t start = to_ms_since_boot(get_absolute_time());
+    const char *fail_step = NULL;
+    char error[64] = "";
+    uint32_t range = image_len > 0 ? (uint32_t)image_len : 0; // 0 = whole chip
+    uint32_t pre_crc = 0, post_crc = 0;
+    job_t job;
+
+    state = AUTO_BUSY;
+    units++;
+
+    for (size_t i = 0; i < NUM_STEPS && !fail_step; i++) {
+        uint8_t step = (uint8_t)(1u << i);
+        if (!(cfg.steps & step)) continue;
+
+        bool ok = true;
+        switch (step) {
+        case AUTO_STEP_IDENTIFY: {
+            const uint8_t *want = cfg.expect_jedec;
+            bool any = !want[0] && !want[1] && !want[2];
+            ok = any || memcmp(id, want, 3) == 0;
+            if (!ok) snprintf(error, sizeof(error), "Unexpected JEDEC ID");
+            break;
+        }
+        case AUTO_STEP_BLANK:
+            ok = run_step(JOB_BLANK, range, &job);
+            break;
+        case AUTO_STEP_HASH:
+            ok = run_step(JOB_HASH, range, &job);
+            pre_crc = job.crc;
+            break;
+        case AUTO_STEP_PROGRAM:
+            ok = image_len > 0 && run_step(JOB_FLASH, range, &job);
+            if (image_len <= 0) snprintf(error, sizeof(error), "No image on SD");
+            break;
+        case AUTO_STEP_VERIFY:
+            ok = image_len > 0 && run_step(JOB_HASH, range, &job);
+            post_crc = job.crc;
+            if (image_len <= 0) {
+                snprintf(error, sizeof(error), "No image on SD");
+            } else if (ok && post_crc != image_crc) {
+                ok = false;
+                snprintf(error, sizeof(error), "CRC mismatch");
+            }
+            break;
+        }
+
+        if (!ok) {
+            fail_step = step_names[i];
+            if (!error[0]) snprintf(error, sizeof(error), "%s", job.result);
+        }
+    }
+
+    bool pass = (fail_step == NULL);
+    if (pass) passed++; else failed++;
+
+    char result[sizeof(last_result)];
+    snprintf(result, sizeof(result),
+             "{\"unit\":%lu,\"jedec\":\"%02X%02X%02X\",\"mfr\":\"%.20s\","
+             "\"result\":\"%s\",\"step\":\"%s\",\"error\":\"%s\","
+             "\"pre_crc32\":\"%08lX\",\"crc32\":\"%08lX\",\"ms\":%lu}",
+             (unsigned long)units, id[0], id[1], id[2], lookup_manufacturer(id[0]),
+             pass ? "pass" : "fail", pass ? "" : fail_step, error,
+             (unsigned long)pre_crc, (unsigned long)post_crc,
+             (unsigned long)(to_ms_since_boot(get_absolute_time()) - start));
+
+    critical_section_enter_blocking(&auto_lock);
+    strcpy(last_result, result);
+    critical_section_exit(&auto_lock);
+
+    printf("[AUTO] %s\n", result);
+    mqtt_enqueue(MQTT_TOPIC_UNITS, result);
+    events_publish("unit", result);
+    if (sd_is_mounted()) {
+        char line[sizeof(result) + 1];
+        size_t n = (size_t)snprintf(line, sizeof(line), "%s\n", result);
+        sd_write_binary_safe(AUTO_LOG_FILE, (const uint8_t *)line, n, true);
+    }
+
+    // A new chip changes everything the diag cache knows about
+    spi_diag_invalidate();
+    state = pass ? AUTO_PASS : AUTO_FAIL;
+}
+
+void auto_mode_poll(void) {
+    if (stop_requested) {
+        stop_requested = false;
+        state = AUTO_OFF;
+    }
+    if (cfg_pending) {
+        critical_section_enter_blocking(&auto_lock);
+        cfg = pending_cfg;
+        cfg_pending = false;
+        critical_section_exit(&auto_lock);
+
+        load_image_reference();
+        stable_count = 0;
+        state = AUTO_WAIT_INSERT;
+        printf("[AUTO] Started: image %s (%ld bytes, crc %08lX)\n", cfg.file,
+               (long)image_len, (unsigned long)image_crc);
+        events_log("Auto mode started: image %s (%ld bytes, crc %08lX)", cfg.file,
+                   (long)image_len, (unsigned long)image_crc);
+    }
+    if (state == AUTO_OFF) return;
+
+    uint32_t now = to_ms_since_boot(get_absolute_time());
+    if ((int32_t)(now - next_poll_ms) < 0) return;
+    next_poll_ms = now + AUTO_POLL_MS;
+
+    uint8_t id[3];
+    if (!read_jedec_id(&id[0], &id[1], &id[2])) return;
+    bool present = jedec_present(id);
+
+    if (state == AUTO_WAIT_INSERT) {
+        // Require the same valid ID several times so a half-seated clip
+        // doesn't start a pipeline
+        if (present && (stable_count == 0 || memcmp(id, seen_id, 3) == 0)) {
+            memcpy(seen_id, id, 3);
+            if (++stable_count >= AUTO_DEBOUNCE_SAMPLES) {
+                stable_count = 0;
+                run_pipeline(id);
+            }
+        } else {
+            stable_count = 0;
+        }
+    } else if (state == AUTO_PASS || state == AUTO_FAIL) {
+        if (!present) {
+            if (++stable_count >= AUTO_DEBOUNCE_SAMPLES) {
+                stable_count = 0;
+                state = AUTO_WAIT_INSERT;
+            }
+        } else {
+            stable_count = 0;
+        }
+    }
+}
@@ -0,0 +1,189 @@
+#include "cbor.h"
+#include "stream_sink.h"
+#include "flash_db.h"
+#include "spi_ops.h"
+#include <string.h>
+
+// --- Chunked writer, same scheme as json.c ---
+
+#define CBOR_CHUNK_SIZE 128
+
+enum {
+  CBOR_UINT = 0,
+  CBOR_BYTES = 2,
+  CBOR_TEXT = 3,
+  CBOR_ARRAY = 4,
+  CBOR_MAP = 5,
+};
+
+typedef struct {
+  stream_sink_t *sink;
+  size_t used;
+  bool failed;
+  uint8_t chunk[CBOR_CHUNK_SIZE];
+} cbor_writer_t;
+
+static bool cw_flush(cbor_writer_t *w) {
+  if (!w->failed && !stream_sink_write(w->sink, w->chunk, w->used))
+    w->failed = true;
+  w->used = 0;
+  return !w->failed;
+}
+
+static void cw_raw(cbor_writer_t *w, const void *data, size_t n) {
+  const uint8_t *s = data;
+  while (n > 0 && !w->failed) {
+    size_t room = CBOR_CHUNK_SIZE - w->used;
+    if (room == 0) {
+      cw_flush(w);
+      continue;
+    }
+    size_t take = (n < room) ? n : room;
+    memcpy(w->chunk + w->used, s, take);
+    w->used += take;
+    s += take;
+    n -= take;
+  }
+}
+
+// Initial byte + argument in the shortest form (RFC 8949 section 3)
+static void cw_head(cbor_writer_t *w, uint8_t major, uint64_t v) {
+  uint8_t buf[9];
+  size_t n;
+  major <<= 5;
+
+  if (v < 24) {
+    buf[0] = major | (uint8_t)v;
+    n = 1;
+  } else if (v <= 0xFF) {
+    buf[0] = major | 24;
+    n = 2;
+  } else if (v <= 0xFFFF) {
+    buf[0] = major | 25;
+    n = 3;
+  } else if (v <= 0xFFFFFFFFu) {
+    buf[0] = major | 26;
+    n = 5;
+  } else {
+    buf[0] = major | 27;
+    n = 9;
+  }
+  for (size_t i = n - 1; i > 0; i--, v >>= 8)
+    buf[i] = (uint8_t)v; // Big-endian argument bytes
+
+  cw_raw(w, buf, n);
+}
+
+static void cw_text(cbor_writer_t *w, const char *s) {
+  size_t n = strlen(s);
+  cw_head(w, CBOR_TEXT, n);
+  cw_raw(w, s, n);
+}
+
+static void cw_bytes(cbor_writer_t *w, const uint8_t *buf, size_t n) {
+  cw_head(w, CBOR_BYTES, n);
+  cw_raw(w, buf, n);
+}
+
+#define cw_uint(w, v) cw_head((w), CBOR_UINT, (v))
+
+#define cw_key(w, k) cw_uint((w), (k))
+
+// Key + unsigned value pair
+static void cw_key_uint(cbor_writer_t *w, cbor_report_key_t key, uint64_t v) {
+  cw_key(w, key);
+  cw_uint(w, v);
+}
+
+static uint64_t capacity_code_to_bytes(uint8_t code) {
+  if (code >= 8 && code < 63) {
+    return (1ULL << code);
+  }
+  return 0;
+}
+
+// --- PUBLIC FUNCTIONS ---
+bool cbor_stream_full_report(stream_sink_t *sink, const uint8_t *report_buf,
+                             size_t report_len) {
+  cbor_writer_t w = {.sink = sink, .used = 0, .failed = false};
+
+  // First pass: JEDEC ID and how many commands fit in the report, since
+  // CBOR containers carry their element count up front
+  uint8_t jedec_m = 0, jedec_t = 0, jedec_c = 0;
+  bool found_jedec = false;
+  size_t count = get_safe_command_count();
+  size_t n_cmds = 0;
+  size_t offset = 0;
+
+  for (size_t i = 0; i < count; i++) {
+    const opcode *cmd = get_command_by_index(i);
+    if (!cmd || offset + cmd->rx_data_len > report_len)
+      break;
+
+    if (cmd->opcode == 0x9F && cmd->rx_data_len >= 3) {
+      jedec_m = report_buf[offset];
+      jedec_t = report_buf[offset + 1];
+      jedec_c = report_buf[offset + 2];
+      found_jedec = true;
+    }
+    offset += cmd->rx_data_len;
+    n_cmds++;
+  }
+
+  cw_head(&w, CBOR_MAP, 2);
+
+  // ---- DEVICE SUBSECTION (JEDEC) ----
+  cw_key(&w, CBOR_KEY_DEVICE);
+  cw_head(&w, CBOR_MAP, found_jedec ? 1 : 0);
+  if (found_jedec) {
+    cw_key(&w, CBOR_KEY_JEDEC);
+    cw_head(&w, CBOR_MAP, 5);
+    cw_key_uint(&w, CBOR_KEY_MANUFACTURER_ID, jedec_m);
+    cw_key(&w, CBOR_KEY_MANUFACTURER_NAME);
+    cw_text(&w, lookup_manufacturer(jedec_m));
+    cw_key_uint(&w, CBOR_KEY_MEMORY_TYPE, jedec_t);
+    cw_key_uint(&w, CBOR_KEY_CAPACITY_CODE, jedec_c);
+    cw_key_uint(&w, CBOR_KEY_CAPACITY_BYTES, capacity_code_to_bytes(jedec_c));
+  }
+
+  // ---- COMMANDS ARRAY ----
+  cw_key(&w, CBOR_KEY_COMMANDS);
+  cw_head(&w, CBOR_ARRAY, n_cmds);
+
+  offset = 0;
+  for (size_t i = 0; i < n_cmds; i++) {
+    const opcode *cmd = get_command_by_index(i);
+
+    cw_head(&w, CBOR_MAP, 3);
+    cw_key(&w, CBOR_KEY_NAME);
+    cw_text(&w, cmd->description ? cmd->description : "");
+    cw_key_uint(&w, CBOR_KEY_OPCODE, cmd->opcode);
+    cw_key(&w, CBOR_KEY_DATA);
+    cw_bytes(&w, report_buf + offset, cmd->rx_data_len);
+    offset += cmd->rx_data_len;
+  }
+
+  return cw_flush(&w);
+}
+
+size_t cbor_export_full_report(uint8_t *out, size_t cap,
+                               const uint8_t *report_buf, size_t report_len) {
+  if (!out || cap < 16)
+    return 0;
+
+  // mem_sink keeps a NUL after the data; harmless for binary output
+  mem_sink_t mem;
+  mem_sink_init(&mem, (char *)out, cap);
+  if (!cbor_stream_full_report(&mem.base, report_buf, report_len))
+    return 0;
+
+  return mem.base.written;
+}
+
+bool cbor_stream_error(stream_sink_t *sink, const char *message) {
+  cbor_writer_t w = {.sink = sink, .used = 0, .failed = false};
+  cw_head(&w, CBOR_MAP, 1);
+  cw_key(&w, CBOR_KEY_ERROR);
+  cw_text(&w, message);
+  return cw_flush(&w);
+}
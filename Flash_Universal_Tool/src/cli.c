@@ -5,6 +5,11 @@
 #include "spi_ops.h"
 #include "flash_info.h"
 #include "json.h"
+#include "sr_monitor.h"
+#include "jobs.h"
+#include "auto_mode.h"
+#include "metrics.h"
+#include "flash_cache.h"
 #include "pico/stdlib.h"
 #include "hardware/gpio.h"
 #include <stdio.h>
@@ -14,6 +19,24 @@
 
 // ========== CLI Helper functions ==========
 
+// Core1 spends most of its time waiting for a key; run background work then
+static void cli_idle_tasks(void) {
+    jobs_poll();
+    auto_mode_poll();
+    sr_monitor_poll();
+}
+
+// getchar() replacement that keeps the idle tasks running
+static int cli_getchar(void) {
+    while (true) {
+        int c = getchar_timeout_us(1000);
+        if (c != PICO_ERROR_TIMEOUT) {
+            return c;
+        }
+        cli_idle_tasks();
+    }
+}
+
 void clear_screen(void) { printf("\033[2J\033[H"); }
 
 void print_header(const char *title) {
@@ -35,7 +58,7 @@ void get_input_line(char *buffer, int max_len) {
     int i = 0;
     char c;
     while (i < max_len - 1) {
-        c = getchar();
+        c = cli_getchar();
         if (c == '\r' || c == '\n') {
             printf("\n");
             break;
@@ -65,7 +88,7 @@ bool confirm_destructive(const char *action) {
     printf("This operation is DESTRUCTIVE. Continue? (y/n): ");
     char c;
     do {
-        c = getchar();
+        c = cli_getchar();
     } while (c == '\n' || c == '\r');
     printf("%c\n", c);
     return (c == 'y' || c == 'Y');
@@ -122,7 +145,7 @@ void print_report_buffer_formatted(const uint8_t *buf, size_t len) {
             printf("\nPress any key to continue...");
             char c;
             do {
-                c = getchar();
+                c = cli_getchar();
             } while (c == PICO_ERROR_TIMEOUT);
             clear_screen();
 
@@ -204,7 +227,7 @@ void print_individual_command(const char *name, uint8_t opcode,
 char get_menu_choice(void) {
     char c;
     do {
-        c = getchar();
+        c = cli_getchar();
     } while (c == PICO_ERROR_TIMEOUT || c == '\n' || c == '\r');
     printf("%c\n", c);
     return c;
@@ -231,6 +254,11 @@ void print_main_menu(void) {
     printf("──────────────────────────────────────────\n");
     printf("  [8] Opcode Fuzzing (Dangerous)\n");
     printf("──────────────────────────────────────────\n");
+    printf("  [9] Status Register Watch (%lu ms)\n",
+           (unsigned long)sr_monitor_get_interval());
+    printf("  [A] Production Auto Mode (%s)\n",
+           auto_mode_state() == AUTO_OFF ? "off" : "on");
+    printf("──────────────────────────────────────────\n");
 }
 
 void cli_core(void) {
@@ -253,10 +281,10 @@ void cli_core(void) {
             uint8_t rx_buffer[3];
             const opcode *jedec_cmd = get_command_by_index(0);
 
-            mutex_enter_blocking(&spi_mutex);
+            metrics_lock(&spi_mutex, METRICS_LOCK_SPI);
             int result = spi_ONE_transfer(SPI_PORT, *jedec_cmd, tx_buffer, rx_buffer);
             gpio_put(CS_PIN, 1);
-            mutex_exit(&spi_mutex);
+            metrics_unlock(&spi_mutex, METRICS_LOCK_SPI);
 
             if (result == 3) {
                 printf("Raw JEDEC: %02X %02X %02X\n", rx_buffer[0], rx_buffer[1], rx_buffer[2]);
@@ -288,9 +316,9 @@ void cli_core(void) {
                 break;
             }
 
-            mutex_enter_blocking(&spi_mutex);
+            metrics_lock(&spi_mutex, METRICS_LOCK_SPI);
             int stored = spi_OPSAFE_transfer(SPI_PORT, master_rx_buffer, report_size);
-            mutex_exit(&spi_mutex);
+            metrics_unlock(&spi_mutex, METRICS_LOCK_SPI);
 
             if (stored > 0) {
                 print_report_buffer_formatted(master_rx_buffer, stored);
@@ -333,10 +361,10 @@ void cli_core(void) {
             memset(txb, 0, tx_len);
             memset(rxb, 0, rx_len);
 
-            mutex_enter_blocking(&spi_mutex);
+            metrics_lock(&spi_mutex, METRICS_LOCK_SPI);
             int res = spi_ONE_transfer(SPI_PORT, *cmd, txb, rxb);
             gpio_put(CS_PIN, 1);
-            mutex_exit(&spi_mutex);
+            metrics_unlock(&spi_mutex, METRICS_LOCK_SPI);
 
             if (res != (int)rx_len) {
                 printf("ERROR: SPI returned %d bytes (expected %d)\n", res, (int)rx_len);
@@ -356,18 +384,23 @@ void cli_core(void) {
 
             size_t expected = get_expected_report_size();
             uint8_t *report = malloc(expected);
+            if (!report) {
+                printf("Memory Allocation Failed\n");
+                break;
+            }
 
-            mutex_enter_blocking(&spi_mutex);
+            metrics_lock(&spi_mutex, METRICS_LOCK_SPI);
             int stored2 = spi_OPSAFE_transfer(SPI_PORT, report, expected);
-            mutex_exit(&spi_mutex);
-
-            size_t json_cap = stored2 * 12 + 4096;
-            char *json = malloc(json_cap);
-
-            json_export_full_report(json, json_cap, report, stored2);
-            printf("%s\n", json);
+            metrics_unlock(&spi_mutex, METRICS_LOCK_SPI);
+
+            // Stream straight to USB instead of rendering into a heap buffer
+            if (stored2 > 0) {
+                stream_sink_t usb;
+                stdio_sink_init(&usb);
+                json_stream_full_report(&usb, report, stored2);
+                printf("\n");
+            }
 
-            free(json);
             free(report);
 
             print_separator();
@@ -474,9 +507,10 @@ void cli_core(void) {
             printf("If the chip hangs, power cycle the device.\n");
 
             if (confirm_destructive("Start Blind Opcode Scan?")) {
-                mutex_enter_blocking(&spi_mutex);
+                metrics_lock(&spi_mutex, METRICS_LOCK_SPI);
                 spi_fuzz_scan(SPI_PORT);
-                mutex_exit(&spi_mutex);
+                metrics_unlock(&spi_mutex, METRICS_LOCK_SPI);
+                flash_cache_invalidate_all(); // Blind opcodes may have erased anything
             } else {
                 printf("\nScan cancelled.\n");
             }
@@ -484,6 +518,50 @@ void cli_core(void) {
             get_menu_choice();
             break;
         }
+        case '9': {
+            clear_screen();
+            print_header("STATUS REGISTER WATCH");
+            printf("\nSamples JEDEC ID + SR1..SR3 while the CLI is idle and\n");
+            printf("publishes changes to %s\n", MQTT_TOPIC_STATUS);
+            printf("Current interval: %lu ms (0 = off)\n",
+                   (unsigned long)sr_monitor_get_interval());
+            print_separator();
+
+            uint32_t interval = get_hex_input("Enter interval in ms (0 = off): ");
+            sr_monitor_set_interval(interval);
+            printf("\nWatch %s\n", interval ? "enabled" : "disabled");
+            sleep_ms(1000);
+            break;
+        }
+        case 'a':
+        case 'A': {
+            clear_screen();
+            print_header("PRODUCTION AUTO MODE");
+
+            if (auto_mode_state() != AUTO_OFF) {
+                auto_mode_stop();
+                printf("\nAuto mode stopped.\n");
+                sleep_ms(1000);
+                break;
+            }
+
+            auto_config_t cfg;
+            auto_mode_default_config(&cfg);
+            printf("\nImage file : %s (SD)\n", cfg.file);
+            printf("Pipeline   : identify, program, verify\n");
+            printf("Results    : %s + %s\n", AUTO_LOG_FILE, MQTT_TOPIC_UNITS);
+            print_separator();
+            cfg.addr = get_hex_input("Enter target address (e.g. 0x0000): ");
+
+            if (confirm_destructive("Every inserted chip will be erased and programmed.")) {
+                auto_mode_start(&cfg);
+                printf("\nAuto mode armed. Insert a chip.\n");
+            } else {
+                printf("\nOperation cancelled.\n");
+            }
+            sleep_ms(1000);
+            break;
+        }
         default: {
             printf("\nInvalid choice.\n");
             sleep_ms(1000);
@@ -0,0 +1,79 @@
+#include "events.h"
+#include "globals.h"
+#include "json.h"
+#include "stream_sink.h"
+#include "pico/critical_section.h"
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+
+// ========== Event Ring ==========
+// Slot = seq % EVENTS_RING_SLOTS. Entries are copied in and out under a
+// spin lock, so a reader never sees a half-written event.
+
+static event_t ring[EVENTS_RING_SLOTS];
+static uint32_t head_seq = 1; // 0 is never used, so a zeroed cursor is "oldest"
+static critical_section_t events_lock;
+static bool events_lock_ready = false;
+
+void events_init(void) {
+    critical_section_init(&events_lock);
+    events_lock_ready = true;
+}
+
+void events_publish(const char *name, const char *json) {
+    if (!events_lock_ready || strlen(json) >= EVENTS_DATA_MAX) return;
+
+    critical_section_enter_blocking(&events_lock);
+    event_t *ev = &ring[head_seq % EVENTS_RING_SLOTS];
+    ev->seq = head_seq++;
+    strncpy(ev->name, name, sizeof(ev->name) - 1);
+    ev->name[sizeof(ev->name) - 1] = '\0';
+    strcpy(ev->data, json);
+    critical_section_exit(&events_lock);
+    core0_wake(); // Push it to /api/events subscribers
+}
+
+void events_log(const char *fmt, ...) {
+    char msg[EVENTS_DATA_MAX / 2];
+    va_list ap;
+    va_start(ap, fmt);
+    vsnprintf(msg, sizeof(msg), fmt, ap);
+    va_end(ap);
+
+    // Worst case every character needs a \u00XX escape; msg is sized so
+    // anything sane fits
+    char json[EVENTS_DATA_MAX];
+    mem_sink_t mem;
+    mem_sink_init(&mem, json, sizeof(json));
+    if (stream_sink_write(&mem.base, "{\"msg\":", 7) && json_stream_string(&mem.base, msg) &&
+        stream_sink_write(&mem.base, "}", 1)) {
+        events_publish("log", json);
+    }
+}
+
+uint32_t events_head(void) {
+    return head_seq; // Single aligned word, no lock needed for a peek
+}
+
+bool events_read(uint32_t *cursor, event_t *out, uint32_t *lost) {
+    if (!events_lock_ready) return false;
+    *lost = 0;
+
+    critical_section_enter_blocking(&events_lock);
+    uint32_t oldest = (head_seq > EVENTS_RING_SLOTS) ? head_seq - EVENTS_RING_SLOTS : 1;
+    if (*cursor > head_seq) {
+        *cursor = head_seq; // Stale Last-Event-ID from before a reboot
+    } else if (*cursor < oldest) {
+        *lost = (*cursor == 0) ? 0 : oldest - *cursor;
+        *cursor = oldest;
+    }
+
+    bool have = (*cursor != head_seq);
+    if (have) {
+        *out = ring[*cursor % EVENTS_RING_SLOTS];
+        (*cursor)++;
+    }
+    critical_section_exit(&events_lock);
+    return have;
+}
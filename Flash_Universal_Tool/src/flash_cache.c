@@ -0,0 +1,120 @@
+#include "flash_cache.h"
+#include "flash_ops.h"
+#include "config.h"
+#include "pico/critical_section.h"
+#include <string.h>
+
+// ========== Sector Cache ==========
+// Slot tags are only touched under the spin lock; sector data is copied
+// outside it. That is safe because only core0 reads or fills slots, and an
+// invalidation only clears a tag. A fill records the generation first and
+// is dropped if an erase / program landed while the SPI read was running.
+
+#define CACHE_EMPTY 0xFFFFFFFFu
+
+typedef struct {
+    uint32_t sector;   // Sector start address, CACHE_EMPTY if unused
+    uint32_t last_use; // LRU stamp, 0 = never
+    uint8_t data[FLASH_SECTOR_SIZE];
+} cache_slot_t;
+
+static cache_slot_t slots[FLASH_CACHE_SECTORS];
+static uint32_t use_clock = 0;
+static uint32_t generation = 0; // Bumped by every invalidation
+static uint32_t hits = 0, misses = 0;
+static critical_section_t cache_lock;
+static bool cache_lock_ready = false;
+
+void flash_cache_init(void) {
+    critical_section_init(&cache_lock);
+    for (int i = 0; i < FLASH_CACHE_SECTORS; i++) {
+        slots[i].sector = CACHE_EMPTY;
+        slots[i].last_use = 0;
+    }
+    cache_lock_ready = true;
+}
+
+// Slot holding `sector`, filled from the chip on a miss; NULL on read error
+static cache_slot_t *get_sector(uint32_t sector) {
+    critical_section_enter_blocking(&cache_lock);
+    cache_slot_t *victim = &slots[0];
+    for (int i = 0; i < FLASH_CACHE_SECTORS; i++) {
+        if (slots[i].sector == sector) {
+            slots[i].last_use = ++use_clock;
+            hits++;
+            critical_section_exit(&cache_lock);
+            return &slots[i];
+        }
+        if (slots[i].last_use < victim->last_use) {
+            victim = &slots[i];
+        }
+    }
+    victim->sector = CACHE_EMPTY;
+    victim->last_use = ++use_clock;
+    uint32_t gen = generation;
+    misses++;
+    critical_section_exit(&cache_lock);
+
+    if (!flash_read_bytes(sector, victim->data, FLASH_SECTOR_SIZE)) {
+        return NULL;
+    }
+
+    critical_section_enter_blocking(&cache_lock);
+    if (generation == gen) {
+        victim->sector = sector; // Otherwise serve it this once, don't keep it
+    }
+    critical_section_exit(&cache_lock);
+    return victim;
+}
+
+bool flash_cache_read(uint32_t addr, uint8_t *buf, size_t len) {
+    if (!cache_lock_ready) return false;
+
+    while (len > 0) {
+        uint32_t sector = addr & ~(FLASH_SECTOR_SIZE - 1);
+        uint32_t offset = addr - sector;
+        size_t n = FLASH_SECTOR_SIZE - offset;
+        if (n > len) n = len;
+
+        cache_slot_t *slot = get_sector(sector);
+        if (!slot) return false;
+        memcpy(buf, slot->data + offset, n);
+
+        addr += n;
+        buf += n;
+        len -= n;
+    }
+    return true;
+}
+
+void flash_cache_invalidate(uint32_t addr, uint32_t len) {
+    if (!cache_lock_ready || len == 0) return;
+
+    critical_section_enter_blocking(&cache_lock);
+    for (int i = 0; i < FLASH_CACHE_SECTORS; i++) {
+        uint32_t s = slots[i].sector;
+        if (s != CACHE_EMPTY && s < addr + len && addr < s + FLASH_SECTOR_SIZE) {
+            slots[i].sector = CACHE_EMPTY;
+            slots[i].last_use = 0; // Reused before any live sector
+        }
+    }
+    generation++;
+    critical_section_exit(&cache_lock);
+}
+
+void flash_cache_invalidate_all(void) {
+    if (!cache_lock_ready) return;
+
+    critical_section_enter_blocking(&cache_lock);
+    for (int i = 0; i < FLASH_CACHE_SECTORS; i++) {
+        slots[i].sector = CACHE_EMPTY;
+        slots[i].last_use = 0;
+    }
+    generation++;
+    critical_section_exit(&cache_lock);
+}
+
+void flash_cache_stats(uint32_t *hit_count, uint32_t *miss_count) {
+    *hit_count = hits;
+    *miss_count = misses;
+}
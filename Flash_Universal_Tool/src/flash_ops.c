@@ -1,6 +1,8 @@
 #include "flash_ops.h"
 #include "globals.h"
 #include "spi_ops.h"
+#include "metrics.h"
+#include "flash_cache.h"
 #include "hardware/gpio.h"
 #include "hardware/spi.h"
 #include "pico/time.h"
@@ -12,8 +14,6 @@
 #define FLASH_READ_DATA 0x03
 #define FLASH_PAGE_PROGRAM 0x02
 #define FLASH_SECTOR_ERASE 0x20
-#define FLASH_PAGE_SIZE 256
-#define FLASH_SECTOR_SIZE 4096
 
 // ========== Internal Flash Helpers ==========
 
@@ -28,6 +28,7 @@ static bool flash_wait_ready(uint32_t timeout_ms) {
         spi_write_blocking(SPI_PORT, &cmd, 1);
         spi_read_blocking(SPI_PORT, 0xFF, &status, 1);
         gpio_put(CS_PIN, 1); // CS Up
+        metrics_spi(FLASH_READ_STATUS, 2);
 
         if (!(status & 0x01)) { // Check BUSY bit (Bit 0)
             return true;
@@ -44,6 +45,7 @@ static void flash_set_write_enable(void) {
     gpio_put(CS_PIN, 0); // CS Down
     spi_write_blocking(SPI_PORT, &cmd, 1);
     gpio_put(CS_PIN, 1); // CS Up
+    metrics_spi(FLASH_WRITE_ENABLE, 1);
 }
 
 // ========== Flash Operations Implementation ==========
@@ -52,7 +54,7 @@ bool flash_read_bytes(uint32_t address, uint8_t *buffer, size_t size) {
     if (!spi_initialized)
         return false;
 
-    mutex_enter_blocking(&spi_mutex);
+    metrics_lock(&spi_mutex, METRICS_LOCK_SPI);
 
     uint8_t cmd_seq[4];
     cmd_seq[0] = FLASH_READ_DATA;
@@ -64,8 +66,9 @@ bool flash_read_bytes(uint32_t address, uint8_t *buffer, size_t size) {
     spi_write_blocking(SPI_PORT, cmd_seq, 4);
     spi_read_blocking(SPI_PORT, 0xFF, buffer, size);
     gpio_put(CS_PIN, 1); // CS Up
+    metrics_spi(FLASH_READ_DATA, 4 + size);
 
-    mutex_exit(&spi_mutex);
+    metrics_unlock(&spi_mutex, METRICS_LOCK_SPI);
     return true;
 }
 
@@ -76,7 +79,7 @@ bool flash_erase_sector(uint32_t address) {
     // Safety: Align to sector start
     address = address & ~(FLASH_SECTOR_SIZE - 1);
 
-    mutex_enter_blocking(&spi_mutex);
+    metrics_lock(&spi_mutex, METRICS_LOCK_SPI);
 
     flash_set_write_enable();
 
@@ -89,11 +92,13 @@ bool flash_erase_sector(uint32_t address) {
     gpio_put(CS_PIN, 0); // CS Down
     spi_write_blocking(SPI_PORT, cmd_seq, 4);
     gpio_put(CS_PIN, 1); // CS Up
+    metrics_spi(FLASH_SECTOR_ERASE, 4);
 
     // Sector erase can take 50ms to 400ms depending on chip
     bool result = flash_wait_ready(500);
 
-    mutex_exit(&spi_mutex);
+    metrics_unlock(&spi_mutex, METRICS_LOCK_SPI);
+    flash_cache_invalidate(address, FLASH_SECTOR_SIZE);
     return result;
 }
 
@@ -101,7 +106,7 @@ bool flash_program_data(uint32_t addr, const uint8_t *data, size_t len) {
     if (!spi_initialized)
         return false;
 
-    mutex_enter_blocking(&spi_mutex);
+    metrics_lock(&spi_mutex, METRICS_LOCK_SPI);
 
     uint32_t current_addr = addr;
     const uint8_t *current_ptr = data;
@@ -126,9 +131,11 @@ bool flash_program_data(uint32_t addr, const uint8_t *data, size_t len) {
         spi_write_blocking(SPI_PORT, cmd_seq, 4);
         spi_write_blocking(SPI_PORT, current_ptr, chunk_len);
         gpio_put(CS_PIN, 1); // CS Up
+        metrics_spi(FLASH_PAGE_PROGRAM, 4 + chunk_len);
 
         if (!flash_wait_ready(50)) { // Page program usually < 3ms
-            mutex_exit(&spi_mutex);
+            metrics_unlock(&spi_mutex, METRICS_LOCK_SPI);
+            flash_cache_invalidate(addr, len);
             printf("✗ Flash Write Timeout at 0x%06X\n", (unsigned int)current_addr);
             return false;
         }
@@ -138,6 +145,7 @@ bool flash_program_data(uint32_t addr, const uint8_t *data, size_t len) {
         remaining_bytes -= chunk_len;
     }
 
-    mutex_exit(&spi_mutex);
+    metrics_unlock(&spi_mutex, METRICS_LOCK_SPI);
+    flash_cache_invalidate(addr, len); // After the write, so no fill can race it
     return true;
 }
\ No newline at end of file
@@ -0,0 +1,264 @@
+#include "http_parser.h"
+#include <ctype.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+// ========== Helpers ==========
+
+// Find "\r\n\r\n" in buf[from..len); returns the offset just past it or 0
+static size_t find_head_end(const char *buf, size_t from, size_t len) {
+    for (size_t i = from; i + 3 < len; i++) {
+        if (buf[i] == '\r' && buf[i + 1] == '\n' && buf[i + 2] == '\r' &&
+            buf[i + 3] == '\n') {
+            return i + 4;
+        }
+    }
+    return 0;
+}
+
+static char *trim(char *s) {
+    while (*s == ' ' || *s == '\t') s++;
+    char *end = s + strlen(s);
+    while (end > s && (end[-1] == ' ' || end[-1] == '\t')) *--end = '\0';
+    return s;
+}
+
+static int hex_value(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    c = (char)tolower((unsigned char)c);
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    return -1;
+}
+
+// Content-Length: digits only, no overflow, and every copy of the header
+// agreeing (RFC 9112 6.3). Anything looser could frame the body
+// differently from a proxy in front of us.
+static bool take_content_length(http_request_t *req, const char *v, bool *seen) {
+    size_t n = 0;
+    if (*v == '\0') return false;
+    for (; *v; v++) {
+        size_t digit = (size_t)(*v - '0');
+        if (*v < '0' || *v > '9' || n > (SIZE_MAX - digit) / 10) return false;
+        n = n * 10 + digit;
+    }
+    if (*seen && n != req->content_length) return false;
+    req->content_length = n;
+    *seen = true;
+    return true;
+}
+
+// Split the header block in place. Only called once per request.
+static http_parse_status_t parse_head(http_request_t *req) {
+    // The head was found by scanning bytes; the string splitting below
+    // would stop short at a NUL and miss the line ends
+    if (memchr(req->buf, '\0', req->head_len)) {
+        return HTTP_PARSE_BAD_REQUEST;
+    }
+
+    char *line = req->buf;
+    char *eol = strstr(line, "\r\n");
+    *eol = '\0';
+
+    // Request line: METHOD SP target SP version
+    char *sp1 = strchr(line, ' ');
+    char *sp2 = sp1 ? strchr(sp1 + 1, ' ') : NULL;
+    if (!sp1 || !sp2 || sp1 == line || sp2 == sp1 + 1 || sp1[1] != '/') {
+        return HTTP_PARSE_BAD_REQUEST;
+    }
+    *sp1 = *sp2 = '\0';
+    req->method = line;
+    req->path = sp1 + 1;
+    req->version = sp2 + 1;
+    if (strncmp(req->version, "HTTP/1.", 7) != 0) {
+        return HTTP_PARSE_BAD_REQUEST;
+    }
+
+    char *q = strchr(sp1 + 1, '?');
+    if (q) {
+        *q = '\0';
+        req->query = q + 1;
+    }
+
+    // Header lines up to the blank line
+    bool have_length = false;
+    for (line = eol + 2; *line != '\r'; line = eol + 2) {
+        eol = strstr(line, "\r\n");
+        *eol = '\0';
+
+        char *colon = strchr(line, ':');
+        if (!colon || colon == line) {
+            return HTTP_PARSE_BAD_REQUEST;
+        }
+        *colon = '\0';
+        char *value = trim(colon + 1);
+
+        // Checked even past the header table, so a second copy can't hide
+        if (strcasecmp(line, "Content-Length") == 0 &&
+            !take_content_length(req, value, &have_length)) {
+            return HTTP_PARSE_BAD_REQUEST;
+        }
+        if (req->n_headers == HTTP_MAX_HEADERS) {
+            continue; // Keep parsing; extra headers are dropped
+        }
+        http_header_t *h = &req->headers[req->n_headers++];
+        h->name = line;
+        h->value = value;
+    }
+
+    const char *te = http_request_header(req, "Transfer-Encoding");
+    if (te && strcasecmp(te, "identity") != 0) {
+        return HTTP_PARSE_BAD_REQUEST; // Chunked request bodies not supported
+    }
+
+    // Digits only, no overflow, and every copy of the header agreeing
+    // (RFC 9112 6.3): anything else could frame the body differently
+    // from a proxy in front of us
+    if (req->content_length > HTTP_REQUEST_MAX - req->head_len) {
+        return HTTP_PARSE_BODY_STREAM; // Caller reads the body itself (or refuses it)
+    }
+
+    req->body = req->buf + req->head_len;
+    return HTTP_PARSE_INCOMPLETE;
+}
+
+// ========== Public API ==========
+
+void http_request_reset(http_request_t *req) {
+    req->len = 0;
+    req->head_len = 0;
+    req->method = req->path = req->version = "";
+    req->query = "";
+    req->n_headers = 0;
+    req->content_length = 0;
+    req->body = NULL;
+    req->buf[0] = '\0';
+}
+
+http_parse_status_t http_request_feed(http_request_t *req, const void *data,
+                                      size_t len, size_t *consumed) {
+    size_t taken = 0;
+
+    if (req->head_len == 0) {
+        // Accumulate until the blank line shows up
+        size_t room = HTTP_REQUEST_MAX - req->len;
+        taken = (len < room) ? len : room;
+        size_t from = (req->len > 3) ? req->len - 3 : 0;
+        memcpy(req->buf + req->len, data, taken);
+        req->len += taken;
+        req->buf[req->len] = '\0';
+
+        size_t head_end = find_head_end(req->buf, from, req->len);
+        if (head_end == 0) {
+            *consumed = taken;
+            return (req->len == HTTP_REQUEST_MAX) ? HTTP_PARSE_HEADERS_TOO_LARGE
+                                                  : HTTP_PARSE_INCOMPLETE;
+        }
+
+        // Anything past the head belongs to the body (or the next request)
+        size_t extra = req->len - head_end;
+        req->len = head_end;
+        req->head_len = head_end;
+        taken -= extra;
+
+        http_parse_status_t status = parse_head(req);
+        if (status != HTTP_PARSE_INCOMPLETE) {
+            *consumed = taken;
+            return status;
+        }
+    }
+
+    // Body: exactly content_length bytes, never more
+    size_t want = req->head_len + req->content_length - req->len;
+    size_t n = (len - taken < want) ? len - taken : want;
+    memcpy(req->buf + req->len, (const char *)data + taken, n);
+    req->len += n;
+    req->buf[req->len] = '\0';
+    taken += n;
+
+    *consumed = taken;
+    return (req->len == req->head_len + req->content_length) ? HTTP_PARSE_DONE
+                                                             : HTTP_PARSE_INCOMPLETE;
+}
+
+const char *http_request_header(const http_request_t *req, const char *name) {
+    for (uint8_t i = 0; i < req->n_headers; i++) {
+        if (strcasecmp(req->headers[i].name, name) == 0) {
+            return req->headers[i].value;
+        }
+    }
+    return NULL;
+}
+
+bool http_request_keep_alive(const http_request_t *req) {
+    const char *conn = http_request_header(req, "Connection");
+    bool http11 = strcmp(req->version, "HTTP/1.0") != 0;
+
+    if (!conn) return http11;
+    if (strcasecmp(conn, "close") == 0) return false;
+    return http11 || strcasecmp(conn, "keep-alive") == 0;
+}
+
+http_range_t http_request_range(const http_request_t *req, uint32_t size,
+                                uint32_t *start, uint32_t *len) {
+    const char *v = http_request_header(req, "Range");
+    if (!v || strncasecmp(v, "bytes=", 6) != 0 || strchr(v, ',')) {
+        return HTTP_RANGE_NONE;
+    }
+    const char *p = v + 6;
+    char *end;
+
+    if (*p == '-') {
+        // Suffix: the last n bytes
+        unsigned long n = strtoul(p + 1, &end, 10);
+        if (end == p + 1 || *end != '\0') return HTTP_RANGE_NONE;
+        if (n == 0 || size == 0) return HTTP_RANGE_UNSATISFIABLE;
+        *start = (n >= size) ? 0 : size - (uint32_t)n;
+        *len = size - *start;
+        return HTTP_RANGE_OK;
+    }
+
+    unsigned long first = strtoul(p, &end, 10);
+    if (end == p || *end != '-') return HTTP_RANGE_NONE;
+    p = end + 1;
+
+    unsigned long last = (unsigned long)size - 1; // "a-" runs to the end
+    if (*p) {
+        last = strtoul(p, &end, 10);
+        if (end == p || *end != '\0' || last < first) return HTTP_RANGE_NONE;
+    }
+    if (first >= size) return HTTP_RANGE_UNSATISFIABLE;
+    if (last >= size) last = size - 1;
+
+    *start = (uint32_t)first;
+    *len = (uint32_t)(last - first + 1);
+    return HTTP_RANGE_OK;
+}
+
+bool http_request_query(const http_request_t *req, const char *name, char *out,
+                        size_t cap) {
+    size_t name_len = strlen(name);
+
+    for (const char *p = req->query; *p; p += strcspn(p, "&"), p += (*p == '&')) {
+        if (strncmp(p, name, name_len) != 0 || p[name_len] != '=') {
+            continue;
+        }
+
+        // Decode %XX and '+' while copying
+        size_t n = 0;
+        for (const char *v = p + name_len + 1; *v && *v != '&'; v++) {
+            char c = *v;
+            if (c == '+') {
+                c = ' ';
+            } else if (c == '%' && hex_value(v[1]) >= 0 && hex_value(v[2]) >= 0) {
+                c = (char)(hex_value(v[1]) << 4 | hex_value(v[2]));
+                v += 2;
+            }
+            if (n + 1 >= cap) return false;
+            out[n++] = c;
+        }
+        out[n] = '\0';
+        return true;
+    }
+    return false;
+}
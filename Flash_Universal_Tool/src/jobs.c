@@ -0,0 +1,566 @@
+#include "jobs.h"
+#include "globals.h"
+#include "flash_ops.h"
+#include "spi_diag.h"
+#include "sd_card.h"
+#include "crc32.h"
+#include "events.h"
+#include "upload.h"
+#include "pico/stdlib.h"
+#include "pico/critical_section.h"
+#include <stdio.h>
+#include <string.h>
+
+// ========== Job Table ==========
+// Slot state changes happen under jobs_lock; core1 owns a job's payload
+// fields while it is RUNNING, core0 only ever reads snapshots.
+
+static job_t jobs[JOB_SLOTS];
+static critical_section_t jobs_lock;
+static bool jobs_lock_ready = false;
+static uint32_t next_job_id = 1;
+
+// Core1-only scratch for flash/SD transfers
+static uint8_t job_buf[JOB_CHUNK_SIZE];
+
+static const char *const job_names[JOB_TYPE_COUNT] = {
+    "scan", "dump", "hash", "erase", "flash", "blank", "upload",
+};
+
+static const char *const state_names[] = {
+    "free", "queued", "running", "done", "failed",
+};
+
+void jobs_init(void) {
+    memset(jobs, 0, sizeof(jobs));
+    critical_section_init(&jobs_lock);
+    jobs_lock_ready = true;
+}
+
+job_type_t job_type_from_name(const char *name) {
+    for (int i = 0; i < JOB_TYPE_COUNT; i++) {
+        if (strcmp(name, job_names[i]) == 0) {
+            return (job_type_t)i;
+        }
+    }
+    return JOB_TYPE_COUNT;
+}
+
+const char *job_type_name(job_type_t type) {
+    return (type < JOB_TYPE_COUNT) ? job_names[type] : "unknown";
+}
+
+uint32_t jobs_submit(job_type_t type, uint32_t addr, uint32_t len,
+                     const char *file) {
+    if (type >= JOB_TYPE_COUNT || !jobs_lock_ready) return 0;
+    critical_section_enter_blocking(&jobs_lock);
+
+    // Prefer a free slot, otherwise recycle the oldest finished job
+    job_t *slot = NULL;
+    for (int i = 0; i < JOB_SLOTS; i++) {
+        job_t *j = &jobs[i];
+        if (j->state == JOB_FREE) {
+            slot = j;
+            break;
+        }
+        if ((j->state == JOB_DONE || j->state == JOB_FAILED) &&
+            (!slot || j->id < slot->id)) {
+            slot = j;
+        }
+    }
+
+    uint32_t id = 0;
+    if (slot) {
+        memset(slot, 0, sizeof(*slot));
+        id = slot->id = next_job_id++;
+        slot->type = type;
+        slot->addr = addr;
+        slot->len = len;
+        const char *def_file = (type == JOB_FLASH) ? IMAGE_FILE : DUMP_FILE;
+        strncpy(slot->file, (file && file[0]) ? file : def_file,
+                sizeof(slot->file) - 1);
+        slot->created_ms = to_ms_since_boot(get_absolute_time());
+        slot->state = JOB_QUEUED;
+    }
+
+    critical_section_exit(&jobs_lock);
+    return id;
+}
+
+bool jobs_get(uint32_t id, job_t *out) {
+    bool found = false;
+    if (!jobs_lock_ready) return false;
+
+    critical_section_enter_blocking(&jobs_lock);
+    for (int i = 0; i < JOB_SLOTS; i++) {
+        if (jobs[i].state != JOB_FREE && jobs[i].id == id) {
+            *out = jobs[i];
+            found = true;
+            break;
+        }
+    }
+    critical_section_exit(&jobs_lock);
+    return found;
+}
+
+size_t jobs_format_json(const job_t *job, char *out, size_t cap) {
+    uint32_t now = to_ms_since_boot(get_absolute_time());
+    uint32_t end = job->finished_ms ? job->finished_ms : now;
+    uint32_t elapsed = job->started_ms ? end - job->started_ms : 0;
+    uint32_t progress = job->total ? (uint32_t)((uint64_t)job->done * 100 / job->total)
+                                   : (job->state == JOB_DONE ? 100 : 0);
+
+    int n = snprintf(out, cap,
+                     "{\"id\":%lu,\"type\":\"%s\",\"state\":\"%s\","
+                     "\"addr\":%lu,\"len\":%lu,\"done\":%lu,\"total\":%lu,"
+                     "\"progress\":%lu,\"elapsed_ms\":%lu",
+                     (unsigned long)job->id, job_type_name(job->type),
+                     state_names[job->state], (unsigned long)job->addr,
+                     (unsigned long)job->len, (unsigned long)job->done,
+                     (unsigned long)job->total, (unsigned long)progress,
+                     (unsigned long)elapsed);
+    if (n < 0 || (size_t)n >= cap) return 0;
+
+    int m;
+    if (job->state == JOB_DONE) {
+        m = snprintf(out + n, cap - n, ",\"result\":%s}",
+                     job->result[0] ? job->result : "{}");
+    } else if (job->state == JOB_FAILED) {
+        m = snprintf(out + n, cap - n, ",\"error\":\"%s\"}", job->result);
+    } else {
+        m = snprintf(out + n, cap - n, "}");
+    }
+    if (m < 0 || (size_t)(n + m) >= cap) return 0;
+    return (size_t)(n + m);
+}
+
+size_t jobs_format_list(char *out, size_t cap) {
+    if (cap < 3 || !jobs_lock_ready) return 0;
+    size_t idx = 0;
+    out[idx++] = '[';
+
+    for (int i = 0; i < JOB_SLOTS; i++) {
+        job_t snap;
+        critical_section_enter_blocking(&jobs_lock);
+        snap = jobs[i];
+        critical_section_exit(&jobs_lock);
+        if (snap.state == JOB_FREE) continue;
+
+        if (idx > 1) out[idx++] = ',';
+        size_t n = jobs_format_json(&snap, out + idx, cap - idx - 2);
+        if (n == 0) return 0;
+        idx += n;
+    }
+
+    out[idx++] = ']';
+    out[idx] = '\0';
+    return idx;
+}
+
+// ========== Live Progress ==========
+// Published to the event ring for /api/events; never blocks the job.
+
+static void publish_job_event(const job_t *job) {
+    char msg[EVENTS_DATA_MAX];
+    if (jobs_format_json(job, msg, sizeof(msg)) > 0) {
+        events_publish("job", msg);
+    }
+}
+
+// Bytes processed: rate-limited progress with throughput, plus the final 100%
+static void job_advance(job_t *job, uint32_t n) {
+    static uint32_t last_event_ms = 0;
+    job->done += n;
+
+    uint32_t now = to_ms_since_boot(get_absolute_time());
+    if (job->done < job->total && now - last_event_ms < EVENTS_PROGRESS_MS) return;
+    last_event_ms = now;
+
+    uint32_t elapsed = now - job->started_ms;
+    char msg[128];
+    snprintf(msg, sizeof(msg),
+             "{\"id\":%lu,\"type\":\"%s\",\"done\":%lu,\"total\":%lu,\"bytes_per_s\":%lu}",
+             (unsigned long)job->id, job_type_name(job->type), (unsigned long)job->done,
+             (unsigned long)job->total,
+             (unsigned long)(elapsed ? (uint64_t)job->done * 1000 / elapsed : 0));
+    events_publish("progress", msg);
+}
+
+// ========== Job Runners (core1) ==========
+
+// Check addr / len against the chip size from the JEDEC capacity code and
+// resolve len == 0 to the rest of the chip. Without a readable size only
+// an explicit range is accepted, and not at all when need_size (erase).
+// Sets job->result when the range is refused.
+static bool check_range(job_t *job, bool need_size) {
+    uint8_t mfr, type, cap;
+    if (!read_jedec_id(&mfr, &type, &cap) || cap < 8 || cap > 31) {
+        if (job->len == 0 || need_size) {
+            snprintf(job->result, sizeof(job->result), "Unknown chip size%s",
+                     need_size ? "" : ", pass len");
+            return false;
+        }
+        if (job->addr + job->len < job->addr) {
+            snprintf(job->result, sizeof(job->result), "addr + len past 4 GB");
+            return false;
+        }
+        return true;
+    }
+
+    uint32_t size = (cap > 24) ? (1u << 24) : (1u << cap); // 3-byte addresses
+    if (job->addr >= size || job->len > size - job->addr) {
+        snprintf(job->result, sizeof(job->result), "Range past the end of the chip (0x%lX)",
+                 (unsigned long)size);
+        return false;
+    }
+    if (job->len == 0) job->len = size - job->addr;
+    return true;
+}
+
+static bool run_scan(job_t *job) {
+    diag_status_t status = spi_diag_refresh();
+    if (status == DIAG_ERROR) {
+        snprintf(job->result, sizeof(job->result), "Diagnostic failed");
+        return false;
+    }
+
+    if (status == DIAG_UPDATED) {
+        spi_diag_save_reports();
+    }
+
+    snprintf(job->result, sizeof(job->result),
+             "{\"etag\":\"%08lX\",\"changed\":%s}",
+             (unsigned long)spi_diag_etag(),
+             status == DIAG_UPDATED ? "true" : "false");
+    return true;
+}
+
+static bool run_blank_check(job_t *job) {
+    if (!check_range(job, false)) return false;
+
+    job->total = job->len;
+    while (job->done < job->total) {
+        uint32_t chunk = job->total - job->done;
+        if (chunk > JOB_CHUNK_SIZE) chunk = JOB_CHUNK_SIZE;
+
+        if (!flash_read_bytes(job->addr + job->done, job_buf, chunk)) {
+            snprintf(job->result, sizeof(job->result), "Flash read failed");
+            return false;
+        }
+        for (uint32_t i = 0; i < chunk; i++) {
+            if (job_buf[i] != 0xFF) {
+                snprintf(job->result, sizeof(job->result), "Not blank at 0x%06lX",
+                         (unsigned long)(job->addr + job->done + i));
+                return false;
+            }
+        }
+        job_advance(job, chunk);
+    }
+
+    snprintf(job->result, sizeof(job->result), "{\"bytes\":%lu,\"blank\":true}",
+             (unsigned long)job->total);
+    return true;
+}
+
+static bool run_dump_or_hash(job_t *job, bool to_sd) {
+    if (!check_range(job, false)) return false;
+    if (to_sd && !sd_ready) {
+        snprintf(job->result, sizeof(job->result), "SD card not ready");
+        return false;
+    }
+
+    // One open file for the whole dump: reopening it per chunk walks the
+    // cluster chain to the end each time
+    if (to_sd && !sd_writer_open(job->file)) {
+        snprintf(job->result, sizeof(job->result), "SD open failed");
+        return false;
+    }
+
+    job->total = job->len;
+    uint32_t crc = 0;
+    const char *error = NULL;
+
+    while (job->done < job->total) {
+        uint32_t chunk = job->total - job->done;
+        if (chunk > JOB_CHUNK_SIZE) chunk = JOB_CHUNK_SIZE;
+
+        if (!flash_read_bytes(job->addr + job->done, job_buf, chunk)) {
+            error = "Flash read failed";
+            break;
+        }
+        crc = crc32_update(crc, job_buf, chunk);
+
+        if (to_sd && !sd_writer_write(job_buf, chunk)) {
+            error = "SD write failed";
+            break;
+        }
+        job_advance(job, chunk);
+    }
+
+    if (to_sd && !sd_writer_close() && !error) {
+        error = "SD write failed";
+    }
+    if (error) {
+        snprintf(job->result, sizeof(job->result), "%s", error);
+        return false;
+    }
+
+    job->crc = crc;
+    if (to_sd) {
+        snprintf(job->result, sizeof(job->result),
+                 "{\"file\":\"%s\",\"bytes\":%lu,\"crc32\":\"%08lX\"}", job->file,
+                 (unsigned long)job->total, (unsigned long)crc);
+    } else {
+        snprintf(job->result, sizeof(job->result),
+                 "{\"bytes\":%lu,\"crc32\":\"%08lX\"}", (unsigned long)job->total,
+                 (unsigned long)crc);
+    }
+    return true;
+}
+
+static bool run_erase(job_t *job) {
+    if (job->len == 0) {
+        snprintf(job->result, sizeof(job->result), "Erase needs an explicit len");
+        return false;
+    }
+    if (!check_range(job, true)) return false;
+
+    uint32_t start = job->addr & ~(FLASH_SECTOR_SIZE - 1);
+    uint32_t end = job->addr + job->len;
+    job->total = end - start;
+
+    for (uint32_t a = start; a < end; a += FLASH_SECTOR_SIZE) {
+        if (!flash_erase_sector(a)) {
+            snprintf(job->result, sizeof(job->result), "Erase failed at 0x%06lX",
+                     (unsigned long)a);
+            return false;
+        }
+        uint32_t done = a + FLASH_SECTOR_SIZE - start;
+        job_advance(job, (done > job->total ? job->total : done) - job->done);
+    }
+
+    snprintf(job->result, sizeof(job->result),
+             "{\"start\":%lu,\"sectors\":%lu}", (unsigned long)start,
+             (unsigned long)((job->total + FLASH_SECTOR_SIZE - 1) / FLASH_SECTOR_SIZE));
+    return true;
+}
+
+static bool run_flash(job_t *job) {
+    if (!sd_ready) {
+        snprintf(job->result, sizeof(job->result), "SD card not ready");
+        return false;
+    }
+    if (job->addr % FLASH_SECTOR_SIZE != 0) {
+        snprintf(job->result, sizeof(job->result), "addr must be sector aligned");
+        return false;
+    }
+
+    int32_t file_size = sd_file_size_safe(job->file);
+    if (file_size <= 0) {
+        snprintf(job->result, sizeof(job->result), "Image file not found");
+        return false;
+    }
+    if (job->len == 0 || job->len > (uint32_t)file_size) {
+        job->len = (uint32_t)file_size;
+    }
+    if (!check_range(job, false)) return false;
+    job->total = job->len;
+
+    uint32_t crc = 0;
+    while (job->done < job->total) {
+        uint32_t addr = job->addr + job->done;
+        uint32_t chunk = job->total - job->done;
+        if (chunk > JOB_CHUNK_SIZE) chunk = JOB_CHUNK_SIZE;
+
+        if (sd_read_binary_safe(job->file, job->done, job_buf, chunk) != (int)chunk) {
+            snprintf(job->result, sizeof(job->result), "SD read failed");
+            return false;
+        }
+        crc = crc32_update(crc, job_buf, chunk);
+
+        // Chunk == one sector, so erase exactly what is about to be written
+        if (!flash_erase_sector(addr) || !flash_program_data(addr, job_buf, chunk)) {
+            snprintf(job->result, sizeof(job->result), "Program failed at 0x%06lX",
+                     (unsigned long)addr);
+            return false;
+        }
+
+        // Verify a page at a time to keep the stack small
+        uint8_t page[FLASH_PAGE_SIZE];
+        for (uint32_t off = 0; off < chunk; off += FLASH_PAGE_SIZE) {
+            uint32_t n = chunk - off;
+            if (n > FLASH_PAGE_SIZE) n = FLASH_PAGE_SIZE;
+            if (!flash_read_bytes(addr + off, page, n) ||
+                memcmp(page, job_buf + off, n) != 0) {
+                snprintf(job->result, sizeof(job->result), "Verify failed at 0x%06lX",
+                         (unsigned long)(addr + off));
+                return false;
+            }
+        }
+        job_advance(job, chunk);
+    }
+
+    job->crc = crc;
+    snprintf(job->result, sizeof(job->result),
+             "{\"file\":\"%s\",\"bytes\":%lu,\"crc32\":\"%08lX\",\"verified\":true}",
+             job->file, (unsigned long)job->total, (unsigned long)crc);
+    return true;
+}
+
+// Program an image as it arrives over HTTP. While the next page isn't in
+// yet, sectors ahead of the write cursor are erased, so erase time hides
+// behind network time instead of adding to it.
+static bool run_upload_stream(job_t *job) {
+    if (!upload_active()) {
+        snprintf(job->result, sizeof(job->result), "No upload in progress");
+        return false;
+    }
+    if (job->len == 0) {
+        snprintf(job->result, sizeof(job->result), "Upload needs a length");
+        return false;
+    }
+    if (!check_range(job, false)) return false;
+
+    uint32_t end = job->addr + job->len;
+    uint32_t erased = job->addr; // Everything below this is erased
+    uint32_t waiting_since = to_ms_since_boot(get_absolute_time());
+    uint32_t crc = 0;
+    job->total = job->len;
+
+    while (job->done < job->total) {
+        uint32_t addr = job->addr + job->done;
+        uint32_t chunk = job->total - job->done;
+        if (chunk > FLASH_PAGE_SIZE) chunk = FLASH_PAGE_SIZE;
+
+        int got = upload_read(job_buf, chunk);
+        if (got < 0) {
+            snprintf(job->result, sizeof(job->result), "Upload aborted at 0x%06lX",
+                     (unsigned long)addr);
+            return false;
+        }
+
+        if (got == 0) {
+            uint32_t now = to_ms_since_boot(get_absolute_time());
+            if (erased < end && erased < addr + UPLOAD_ERASE_AHEAD) {
+                if (!flash_erase_sector(erased)) {
+                    snprintf(job->result, sizeof(job->result), "Erase failed at 0x%06lX",
+                             (unsigned long)erased);
+                    return false;
+                }
+                erased += FLASH_SECTOR_SIZE;
+            } else if (now - waiting_since > UPLOAD_STALL_MS) {
+                snprintf(job->result, sizeof(job->result), "Upload stalled at 0x%06lX",
+                         (unsigned long)addr);
+                return false;
+            } else {
+                sleep_us(200);
+            }
+            continue;
+        }
+        waiting_since = to_ms_since_boot(get_absolute_time());
+
+        // Data outran the erase-ahead (fast link): catch up first
+        while (erased <= addr) {
+            if (!flash_erase_sector(erased)) {
+                snprintf(job->result, sizeof(job->result), "Erase failed at 0x%06lX",
+                         (unsigned long)erased);
+                return false;
+            }
+            erased += FLASH_SECTOR_SIZE;
+        }
+
+        uint8_t check[FLASH_PAGE_SIZE];
+        if (!flash_program_data(addr, job_buf, chunk)) {
+            snprintf(job->result, sizeof(job->result), "Program failed at 0x%06lX",
+                     (unsigned long)addr);
+            return false;
+        }
+        if (!flash_read_bytes(addr, check, chunk) || memcmp(check, job_buf, chunk) != 0) {
+            snprintf(job->result, sizeof(job->result), "Verify failed at 0x%06lX",
+                     (unsigned long)addr);
+            return false;
+        }
+        crc = crc32_update(crc, job_buf, chunk);
+        job_advance(job, chunk);
+    }
+
+    job->crc = crc;
+    snprintf(job->result, sizeof(job->result),
+             "{\"bytes\":%lu,\"crc32\":\"%08lX\",\"verified\":true}",
+             (unsigned long)job->total, (unsigned long)crc);
+    return true;
+}
+
+static bool run_upload(job_t *job) {
+    bool ok = run_upload_stream(job);
+    upload_close(); // Every exit path, so core0 can accept the next upload
+    return ok;
+}
+
+static bool run_job(job_t *job) {
+    switch (job->type) {
+    case JOB_SCAN:
+        return run_scan(job);
+    case JOB_DUMP:
+        return run_dump_or_hash(job, true);
+    case JOB_HASH:
+        return run_dump_or_hash(job, false);
+    case JOB_ERASE:
+        return run_erase(job);
+    case JOB_FLASH:
+        return run_flash(job);
+    case JOB_BLANK:
+        return run_blank_check(job);
+    case JOB_UPLOAD:
+        return run_upload(job);
+    default:
+        snprintf(job->result, sizeof(job->result), "Unknown job type");
+        return false;
+    }
+}
+
+bool jobs_run_now(job_t *job) {
+    job->started_ms = to_ms_since_boot(get_absolute_time());
+    job->done = 0;
+    job->total = 0;
+    job->crc = 0;
+    job->result[0] = '\0';
+    return run_job(job);
+}
+
+void jobs_poll(void) {
+    if (!jobs_lock_ready) return;
+
+    // Claim the oldest queued job
+    job_t *job = NULL;
+    critical_section_enter_blocking(&jobs_lock);
+    for (int i = 0; i < JOB_SLOTS; i++) {
+        if (jobs[i].state == JOB_QUEUED && (!job || jobs[i].id < job->id)) {
+            job = &jobs[i];
+        }
+    }
+    if (job) {
+        job->started_ms = to_ms_since_boot(get_absolute_time());
+        job->state = JOB_RUNNING;
+    }
+    critical_section_exit(&jobs_lock);
+
+    if (!job) return;
+
+    printf("[JOB] #%lu %s started\n", (unsigned long)job->id, job_type_name(job->type));
+    publish_job_event(job);
+    events_log("Job #%lu %s started", (unsigned long)job->id, job_type_name(job->type));
+
+    bool ok = run_job(job);
+
+    critical_section_enter_blocking(&jobs_lock);
+    job->finished_ms = to_ms_since_boot(get_absolute_time());
+    job->state = ok ? JOB_DONE : JOB_FAILED;
+    critical_section_exit(&jobs_lock);
+
+    printf("[JOB] #%lu %s %s\n", (unsigned long)job->id, job_type_name(job->type),
+           ok ? "done" : "failed");
+    publish_job_event(job);
+    events_log("Job #%lu %s %s", (unsigned long)job->id, job_type_name(job->type),
+               ok ? "done" : "failed");
+}
@@ -1,40 +1,131 @@
 #include "json.h"
+#include "stream_sink.h"
 #include "flash_db.h"
 #include "spi_ops.h"
-#include <stdarg.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
-// --- Small internal logger/escaper ---
+// --- Chunked writer: encodes into a small buffer, flushes to the sink ---
 
-static const char *json_escape(const char *s, char *tmp, size_t tmp_cap) {
-  size_t w = 0;
-  for (size_t i = 0; s[i] && w + 2 < tmp_cap; i++) {
-    char c = s[i];
+#define JSON_CHUNK_SIZE 256
+
+typedef struct {
+  stream_sink_t *sink;
+  size_t used;
+  bool failed;
+  char chunk[JSON_CHUNK_SIZE];
+} json_writer_t;
+
+static const char hex_digits[16] = "0123456789ABCDEF";
+
+static bool jw_flush(json_writer_t *w) {
+  if (!w->failed && !stream_sink_write(w->sink, w->chunk, w->used))
+    w->failed = true;
+  w->used = 0;
+  return !w->failed;
+}
+
+// Make room for n contiguous bytes (n <= JSON_CHUNK_SIZE); NULL on failure
+static inline char *jw_reserve(json_writer_t *w, size_t n) {
+  if (w->failed)
+    return NULL;
+  if (JSON_CHUNK_SIZE - w->used < n && !jw_flush(w))
+    return NULL;
+  char *p = w->chunk + w->used;
+  w->used += n;
+  return p;
+}
+
+// --- Value encoders: write straight into the chunk, no printf ---
+
+static void jw_raw(json_writer_t *w, const char *s, size_t n) {
+  while (n > 0 && !w->failed) {
+    size_t room = JSON_CHUNK_SIZE - w->used;
+    if (room == 0) {
+      jw_flush(w);
+      continue;
+    }
+    size_t take = (n < room) ? n : room;
+    memcpy(w->chunk + w->used, s, take);
+    w->used += take;
+    s += take;
+    n -= take;
+  }
+}
+
+#define jw_lit(w, s) jw_raw((w), (s), sizeof(s) - 1)
+
+// "XX" with the quotes, e.g. opcode / register values
+static void jw_hex_byte(json_writer_t *w, uint8_t b) {
+  char *p = jw_reserve(w, 4);
+  if (!p)
+    return;
+  p[0] = '"';
+  p[1] = hex_digits[b >> 4];
+  p[2] = hex_digits[b & 0x0F];
+  p[3] = '"';
+}
+
+static void jw_uint(json_writer_t *w, uint64_t v) {
+  char tmp[20];
+  size_t n = 0;
+  do {
+    tmp[sizeof(tmp) - 1 - n++] = (char)('0' + v % 10);
+    v /= 10;
+  } while (v);
+  jw_raw(w, tmp + sizeof(tmp) - n, n);
+}
+
+// Quoted, escaped string
+static void jw_string(json_writer_t *w, const char *s) {
+  jw_lit(w, "\"");
+  const char *run = s;
+  for (; *s; s++) {
+    unsigned char c = (unsigned char)*s;
+    if (c != '"' && c != '\\' && c >= 0x20)
+      continue;
+    jw_raw(w, run, (size_t)(s - run));
+    char *p;
     if (c == '"' || c == '\\') {
-      tmp[w++] = '\\';
+      if ((p = jw_reserve(w, 2))) {
+        p[0] = '\\';
+        p[1] = (char)c;
+      }
+    } else if ((p = jw_reserve(w, 6))) {
+      memcpy(p, "\\u00", 4);
+      p[4] = hex_digits[c >> 4];
+      p[5] = hex_digits[c & 0x0F];
     }
-    tmp[w++] = c;
+    run = s + 1;
   }
-  tmp[w] = 0;
-  return tmp;
+  jw_raw(w, run, (size_t)(s - run));
+  jw_lit(w, "\"");
 }
 
-static size_t appendf(char *dst, size_t cap, size_t *idx, const char *fmt,
-                      ...) {
-  if (*idx >= cap)
-    return 0;
-  va_list ap;
-  va_start(ap, fmt);
-  int n = vsnprintf(dst + *idx, cap - *idx, fmt, ap);
-  va_end(ap);
-  if (n < 0 || (size_t)n >= cap - *idx) {
-    *idx = cap;
-    return 0;
+// ["XX","XX",...]: 5 bytes per element, emitted a chunk's worth at a time
+static void jw_hex_array(json_writer_t *w, const uint8_t *buf, size_t n) {
+  jw_lit(w, "[");
+  for (size_t i = 0; i < n && !w->failed;) {
+    size_t room = (JSON_CHUNK_SIZE - w->used) / 5;
+    if (room == 0) {
+      jw_flush(w);
+      continue;
+    }
+    size_t batch = (n - i < room) ? n - i : room;
+    char *p = w->chunk + w->used;
+    for (size_t k = 0; k < batch; k++, i++) {
+      *p++ = '"';
+      *p++ = hex_digits[buf[i] >> 4];
+      *p++ = hex_digits[buf[i] & 0x0F];
+      *p++ = '"';
+      *p++ = ',';
+    }
+    w->used = (size_t)(p - w->chunk);
   }
-  *idx += (size_t)n;
-  return (size_t)n;
+  if (n > 0 && !w->failed)
+    w->used--; // Drop the trailing comma
+  jw_lit(w, "]");
 }
 
 // Compute byte capacity from JEDEC exponent-style code — returns 0 if unknown.
@@ -45,31 +136,30 @@ static uint64_t capacity_code_to_bytes(uint8_t code) {
   return 0;
 }
 
-static void write_hex_array(char *dst, size_t cap, size_t *idx,
-                            const uint8_t *buf, size_t n) {
-  appendf(dst, cap, idx, "[");
-  for (size_t i = 0; i < n; i++) {
-    appendf(dst, cap, idx, "\"%02X\"%s", buf[i], (i + 1 < n ? "," : ""));
-  }
-  appendf(dst, cap, idx, "]");
+// --- PUBLIC FUNCTIONS ---
+bool json_stream_hex_array(stream_sink_t *sink, const uint8_t *buf, size_t n) {
+  json_writer_t w = {.sink = sink, .used = 0, .failed = false};
+  jw_hex_array(&w, buf, n);
+  return jw_flush(&w);
 }
 
-// --- PUBLIC FUNCTION ---
-size_t json_export_full_report(char *out, size_t cap, const uint8_t *report_buf,
-                               size_t report_len) {
-  if (!out || cap < 16)
-    return 0;
+bool json_stream_string(stream_sink_t *sink, const char *s) {
+  json_writer_t w = {.sink = sink, .used = 0, .failed = false};
+  jw_string(&w, s);
+  return jw_flush(&w);
+}
 
-  size_t idx = 0;
-  appendf(out, cap, &idx, "{");
+bool json_stream_full_report(stream_sink_t *sink, const uint8_t *report_buf,
+                             size_t report_len) {
+  json_writer_t w = {.sink = sink, .used = 0, .failed = false};
+  jw_lit(&w, "{");
 
   // ---- DEVICE SUBSECTION (JEDEC) ----
-  appendf(out, cap, &idx, "\"device\":{");
+  jw_lit(&w, "\"device\":{");
 
   uint8_t jedec_m = 0, jedec_t = 0, jedec_c = 0;
   uint8_t found_jedec = 0;
 
-  char esc[128];
   size_t offset = 0;
   size_t count = get_safe_command_count();
 
@@ -94,22 +184,23 @@ size_t json_export_full_report(char *out, size_t cap, const uint8_t *report_buf,
     const char *man = lookup_manufacturer(jedec_m);
     uint64_t cap_bytes = capacity_code_to_bytes(jedec_c);
 
-    appendf(out, cap, &idx,
-            "\"jedec\":{"
-            "\"manufacturer_id\":\"%02X\","
-            "\"manufacturer_name\":\"%s\","
-            "\"memory_type\":\"%02X\","
-            "\"capacity_code\":\"%02X\","
-            "\"capacity_bytes\":\"%llu\""
-            "}",
-            jedec_m, json_escape(man, esc, sizeof esc), jedec_t, jedec_c,
-            (unsigned long long)cap_bytes);
+    jw_lit(&w, "\"jedec\":{\"manufacturer_id\":");
+    jw_hex_byte(&w, jedec_m);
+    jw_lit(&w, ",\"manufacturer_name\":");
+    jw_string(&w, man);
+    jw_lit(&w, ",\"memory_type\":");
+    jw_hex_byte(&w, jedec_t);
+    jw_lit(&w, ",\"capacity_code\":");
+    jw_hex_byte(&w, jedec_c);
+    jw_lit(&w, ",\"capacity_bytes\":\"");
+    jw_uint(&w, cap_bytes);
+    jw_lit(&w, "\"}");
   }
 
-  appendf(out, cap, &idx, "},"); // end "device"
+  jw_lit(&w, "},"); // end "device"
 
   // ---- COMMANDS ARRAY ----
-  appendf(out, cap, &idx, "\"commands\":[");
+  jw_lit(&w, "\"commands\":[");
 
   offset = 0;
   for (size_t i = 0; i < count; i++) {
@@ -119,24 +210,35 @@ size_t json_export_full_report(char *out, size_t cap, const uint8_t *report_buf,
     if (offset + cmd->rx_data_len > report_len)
       break;
 
-    appendf(out, cap, &idx, "{");
-
-    appendf(
-        out, cap, &idx, "\"name\":\"%s\",",
-        json_escape(cmd->description ? cmd->description : "", esc, sizeof esc));
-    appendf(out, cap, &idx, "\"opcode\":\"%02X\",", cmd->opcode);
-    appendf(out, cap, &idx, "\"data\":");
-    write_hex_array(out, cap, &idx, report_buf + offset, cmd->rx_data_len);
-
-    appendf(out, cap, &idx, "}%s", (i + 1 < count ? "," : ""));
+    jw_lit(&w, "{\"name\":");
+    jw_string(&w, cmd->description ? cmd->description : "");
+    jw_lit(&w, ",\"opcode\":");
+    jw_hex_byte(&w, cmd->opcode);
+    jw_lit(&w, ",\"data\":");
+    jw_hex_array(&w, report_buf + offset, cmd->rx_data_len);
+
+    if (i + 1 < count)
+      jw_lit(&w, "},");
+    else
+      jw_lit(&w, "}");
     offset += cmd->rx_data_len;
   }
 
-  appendf(out, cap, &idx, "]"); // end array
-  appendf(out, cap, &idx, "}"); // end root
+  jw_lit(&w, "]"); // end array
+  jw_lit(&w, "}"); // end root
+
+  return jw_flush(&w);
+}
+
+size_t json_export_full_report(char *out, size_t cap, const uint8_t *report_buf,
+                               size_t report_len) {
+  if (!out || cap < 16)
+    return 0;
 
-  if (idx >= cap)
+  mem_sink_t mem;
+  mem_sink_init(&mem, out, cap);
+  if (!json_stream_full_report(&mem.base, report_buf, report_len))
     return 0; // Buffer overflow/trunc
 
-  return idx;
+  return mem.base.written;
 }
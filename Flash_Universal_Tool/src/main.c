@@ -8,6 +8,7 @@
 #include "lwip/dns.h"
 #include "lwip/pbuf.h"
 #include "lwip/tcp.h"
+#include "pico/async_context.h"
 #include "pico/cyw43_arch.h"
 #include "pico/multicore.h"
 #include "pico/mutex.h"
@@ -20,6 +21,13 @@
 #include "flash_ops.h"
 #include "spi_diag.h"
 #include "cli.h"
+#include "jobs.h"
+#include "auto_mode.h"
+#include "events.h"
+#include "upload.h"
+#include "flash_cache.h"
+#include "metrics.h"
+#include "mqtt_journal.h"
 
 #include <stdio.h>
 #include <string.h>
@@ -30,8 +38,161 @@ bool sd_ready = false;
 bool spi_initialized = false;
 uint8_t last_jedec_id[3] = {0xFF, 0xFF, 0xFF};
 
-mutex_t spi_mutex;
-mutex_t buffer_mutex;
+recursive_mutex_t spi_mutex;
+recursive_mutex_t buffer_mutex;
+
+// ========== Core0 Event Loop ==========
+// core0 has no polling loop. The workers below run in the cyw43 async
+// context (background IRQ, lwIP lock held) when something happens: the
+// service pass when core0_wake() is called or a retry is due, the LED and
+// status print on timers. Time spent in them is reported as busy.
+
+static async_when_pending_worker_t service_worker;
+static async_at_time_worker_t retry_worker;
+static async_at_time_worker_t led_worker;
+static async_at_time_worker_t status_worker;
+static volatile bool core0_loop_ready = false;
+static bool retry_armed = false;
+
+void core0_wake(void) {
+    if (core0_loop_ready) {
+        async_context_set_work_pending(cyw43_arch_async_context(), &service_worker);
+    }
+}
+
+static void service_pass(async_context_t *ctx) {
+    uint32_t start = time_us_32();
+
+    // Publish anything core1 queued (status watch events)
+    bool again = mqtt_service();
+
+    // Push new events to /api/events subscribers, retry waiting requests
+    if (http_server_service()) {
+        again = true;
+    }
+
+    // Nothing will wake us for a busy bus or a full buffer, so look again soon
+    if (again && !retry_armed) {
+        retry_armed = true;
+        async_context_add_at_time_worker_in_ms(ctx, &retry_worker, CORE0_RETRY_MS);
+    }
+    metrics_core0_busy(time_us_32() - start);
+}
+
+static void service_work(async_context_t *ctx, async_when_pending_worker_t *worker) {
+    service_pass(ctx);
+}
+
+static void retry_work(async_context_t *ctx, async_at_time_worker_t *worker) {
+    retry_armed = false;
+    service_pass(ctx);
+}
+
+// Sets the LED and sleeps until its next edge, so a blink never blocks
+static void led_work(async_context_t *ctx, async_at_time_worker_t *worker) {
+    static bool led = false;
+    uint32_t start = time_us_32();
+    uint32_t now = to_ms_since_boot(get_absolute_time());
+    uint32_t next;
+    bool want;
+
+    // Auto mode owns the LED: solid = pass, fast blink = fail, slow = busy
+    auto_state_t auto_state = auto_mode_state();
+    if (auto_state == AUTO_PASS) {
+        want = true;
+        next = 200; // Only to notice the state changing
+    } else if (auto_state == AUTO_FAIL || auto_state == AUTO_BUSY) {
+        uint32_t period = (auto_state == AUTO_FAIL) ? 100 : 400;
+        want = (now / period) & 1;
+        next = period - now % period;
+    } else {
+        // Heartbeat: 50 ms flash once a second
+        uint32_t phase = now % 1000;
+        want = phase < 50;
+        next = want ? 50 - phase : 1000 - phase;
+    }
+
+    if (want != led) { // Only talk to the CYW43 on a change
+        cyw43_arch_gpio_put(CYW43_WL_GPIO_LED_PIN, want);
+        led = want;
+    }
+    async_context_add_at_time_worker_in_ms(ctx, worker, next);
+    metrics_core0_busy(time_us_32() - start);
+}
+
+static void status_work(async_context_t *ctx, async_at_time_worker_t *worker) {
+    static uint64_t last_busy_us = 0;
+    static uint64_t last_us = 0;
+    uint32_t start = time_us_32();
+    uint32_t now = to_ms_since_boot(get_absolute_time());
+
+    uint64_t busy_us, now_us = time_us_64();
+    uint32_t wakeups;
+    metrics_core0_stats(&busy_us, &wakeups);
+
+    printf("\n--- System Status ---\n");
+    printf("Uptime: %lu seconds\n", now / 1000);
+    printf("WiFi: %s\n", pico_ip_address);
+    mqtt_conn_stats_t mqtt;
+    mqtt_conn_stats(&mqtt);
+    printf("MQTT: %s (connects %lu, lost %lu, failed attempts %lu)\n",
+           mqtt_is_connected() ? "Connected" : "Disconnected", (unsigned long)mqtt.connects,
+           (unsigned long)mqtt.disconnects, (unsigned long)mqtt.connect_failures);
+    printf("Last JEDEC: %02X %02X %02X\n", last_jedec_id[0], last_jedec_id[1], last_jedec_id[2]);
+    http_pool_stats_t http;
+    http_server_pool_stats(&http);
+    printf("HTTP slots: %u/%d in use, peak %u, rejected %lu, "
+           "request peak %u/%d, response peak %u/%d\n",
+           http.in_use, MAX_HTTP_CONNECTIONS, http.in_use_peak,
+           (unsigned long)http.rejected, http.request_peak, HTTP_REQUEST_MAX,
+           http.response_peak, HTTP_RESPONSE_MAX);
+    mqtt_delivery_stats_t delivery;
+    mqtt_delivery_stats(&delivery);
+    uint32_t ack_avg_us = delivery.delivered ? delivery.ack_us_sum / delivery.delivered : 0;
+    printf("MQTT delivery: %lu delivered, %lu retried, %lu dropped, %lu in flight, "
+           "PUBACK avg %lu ms, max %lu ms\n",
+           (unsigned long)delivery.delivered, (unsigned long)delivery.retried,
+           (unsigned long)delivery.dropped, (unsigned long)delivery.in_flight,
+           (unsigned long)(ack_avg_us / 1000),
+           (unsigned long)(delivery.ack_us_max / 1000));
+    if (mqtt_outbox_drops() > 0) {
+        printf("MQTT outbox drops: %lu\n", (unsigned long)mqtt_outbox_drops());
+    }
+    uint32_t jnl_messages, jnl_bytes, jnl_drops;
+    journal_stats(&jnl_messages, &jnl_bytes, &jnl_drops);
+    if (jnl_messages > 0 || jnl_drops > 0) {
+        printf("MQTT journal: %lu waiting (%lu bytes), %lu dropped\n",
+               (unsigned long)jnl_messages, (unsigned long)jnl_bytes, (unsigned long)jnl_drops);
+    }
+    // Per mille of the interval spent in the workers; the rest core0 slept
+    // (or was in lwIP itself)
+    uint32_t permille = (now_us > last_us)
+                            ? (uint32_t)((busy_us - last_busy_us) * 1000 / (now_us - last_us))
+                            : 0;
+    printf("Core0: %lu.%lu%% busy, %lu wakeups\n", (unsigned long)(permille / 10),
+           (unsigned long)(permille % 10), (unsigned long)wakeups);
+    last_busy_us = busy_us;
+    last_us = now_us;
+
+    async_context_add_at_time_worker_in_ms(ctx, worker, STATUS_INTERVAL_MS);
+    metrics_core0_busy(time_us_32() - start);
+}
+
+// Register the workers; core1 may call core0_wake() once this returns
+static void core0_loop_init(void) {
+    async_context_t *ctx = cyw43_arch_async_context();
+
+    service_worker.do_work = service_work;
+    retry_worker.do_work = retry_work;
+    led_worker.do_work = led_work;
+    status_worker.do_work = status_work;
+
+    async_context_add_when_pending_worker(ctx, &service_worker);
+    async_context_add_at_time_worker_in_ms(ctx, &led_worker, 0);
+    async_context_add_at_time_worker_in_ms(ctx, &status_worker, STATUS_INTERVAL_MS);
+    core0_loop_ready = true;
+    core0_wake(); // Anything queued during startup
+}
 
 // ========== Main Application ==========
 int main(void) {
@@ -47,8 +208,9 @@ int main(void) {
 
     // Initialize SPI
     printf("--- Initializing SPI ---\n");
-    mutex_init(&spi_mutex);
-    mutex_init(&buffer_mutex);
+    recursive_mutex_init(&spi_mutex);
+    recursive_mutex_init(&buffer_mutex);
+    events_init();
     spi_master_init();
     spi_initialized = true;
     printf("✓ SPI initialized\n");
@@ -94,35 +256,17 @@ int main(void) {
     printf("✅ SD Card: %s\n", sd_ready ? "Ready" : "Not available");
     printf("==================================\n\n");
 
-    // Main loop
-    uint32_t last_status = 0;
-
+    jobs_init();
+    upload_init();
+    flash_cache_init();
+    auto_mode_init();
+    core0_loop_init();
     multicore_launch_core1(cli_core);
 
+    // Main loop: all the work happens in the workers above, which the
+    // background IRQ runs; thread context only sleeps between interrupts
     while (true) {
-        cyw43_arch_poll();
-        sleep_ms(10);
-
-        uint32_t now = to_ms_since_boot(get_absolute_time());
-
-        // Periodic status update
-        if (now - last_status >= 60000) {
-            printf("\n--- System Status ---\n");
-            printf("Uptime: %lu seconds\n", now / 1000);
-            printf("WiFi: %s\n", pico_ip_address);
-            printf("MQTT: %s\n", mqtt_is_connected() ? "Connected" : "Disconnected"); 
-            printf("Last JEDEC: %02X %02X %02X\n", last_jedec_id[0], last_jedec_id[1], last_jedec_id[2]);
-            last_status = now;
-        }
-
-        // LED heartbeat
-        static uint32_t last_blink = 0;
-        if (now - last_blink >= 1000) {
-            cyw43_arch_gpio_put(CYW43_WL_GPIO_LED_PIN, 1);
-            sleep_ms(50);
-            cyw43_arch_gpio_put(CYW43_WL_GPIO_LED_PIN, 0);
-            last_blink = now;
-        }
+        cyw43_arch_wait_for_work_until(at_the_end_of_time);
     }
 
     return 0;
@@ -0,0 +1,459 @@
+#include "metrics.h"
+#include "mqtt.h"
+#include "mqtt_journal.h"
+#include "web_server.h"
+#include "flash_cache.h"
+#include "pico/stdlib.h"
+#include <stdarg.h>
+#include <stdio.h>
+
+// ========== Storage ==========
+// One copy per core, written only by that core. Latencies go into fixed
+// buckets (counts per bucket, cumulated when rendered) so an observation
+// is a short compare loop and two adds.
+
+#define METRICS_BUCKETS 9
+
+static const uint32_t bucket_us[METRICS_BUCKETS] = {
+    50, 250, 1000, 5000, 25000, 100000, 500000, 2000000, 10000000,
+};
+static const char *const bucket_le[METRICS_BUCKETS] = {
+    "0.00005", "0.00025", "0.001", "0.005", "0.025", "0.1", "0.5", "2", "10",
+};
+
+typedef struct {
+    uint32_t buckets[METRICS_BUCKETS + 1]; // Last one is +Inf
+    uint64_t sum_us;
+} hist_t;
+
+typedef struct {
+    uint32_t transactions;
+    uint64_t bytes;
+} spi_stat_t;
+
+typedef struct {
+    uint8_t spi_slot[256]; // Opcode -> index into spi[], 0 = not seen yet
+    uint8_t spi_used;
+    spi_stat_t spi[METRICS_SPI_OPCODES]; // [0] collects opcodes past the table
+    hist_t lock_wait[METRICS_LOCK_COUNT];
+    hist_t lock_hold[METRICS_LOCK_COUNT];
+    uint32_t lock_busy[METRICS_LOCK_COUNT]; // Failed try_lock
+    uint32_t sd_sectors[2];                 // [0] read, [1] write
+    uint32_t sd_errors[2];
+    hist_t sd_latency[2];
+    uint32_t mqtt[METRICS_MQTT_COUNT];
+    hist_t mqtt_ack;
+    hist_t http[METRICS_HTTP_ROUTES + 1]; // Last one is "other"
+} core_metrics_t;
+
+static core_metrics_t cores[2];
+static uint64_t core0_busy_us; // core0 only
+static uint32_t core0_wakeups;
+static uint32_t held_since[METRICS_LOCK_COUNT]; // Only the holder writes these
+static uint8_t depth[METRICS_LOCK_COUNT];
+static const char *route_method[METRICS_HTTP_ROUTES];
+static const char *route_path[METRICS_HTTP_ROUTES];
+
+static const char *const lock_names[METRICS_LOCK_COUNT] = {"spi", "buffer", "sd"};
+static const char *const sd_ops[2] = {"read", "write"};
+static const char *const mqtt_results[METRICS_MQTT_COUNT] = {"ok", "error", "retry"};
+
+static inline core_metrics_t *local(void) {
+    return &cores[get_core_num()];
+}
+
+static void hist_observe(hist_t *h, uint32_t us) {
+    size_t b = 0;
+    while (b < METRICS_BUCKETS && us > bucket_us[b]) b++;
+    h->buckets[b]++;
+    h->sum_us += us;
+}
+
+// ========== Recording ==========
+
+void metrics_spi(uint8_t opcode, size_t bytes) {
+    core_metrics_t *m = local();
+    uint8_t slot = m->spi_slot[opcode];
+    if (slot == 0 && m->spi_used + 1 < METRICS_SPI_OPCODES) {
+        slot = m->spi_slot[opcode] = ++m->spi_used;
+    }
+    m->spi[slot].transactions++;
+    m->spi[slot].bytes += bytes;
+}
+
+void metrics_lock(recursive_mutex_t *mtx, metrics_lock_t lock) {
+    uint32_t start = time_us_32();
+    recursive_mutex_enter_blocking(mtx);
+    if (depth[lock]++ == 0) {
+        uint32_t now = time_us_32();
+        hist_observe(&local()->lock_wait[lock], now - start);
+        held_since[lock] = now;
+    }
+}
+
+bool metrics_try_lock(recursive_mutex_t *mtx, metrics_lock_t lock) {
+    if (!recursive_mutex_try_enter(mtx, NULL)) {
+        local()->lock_busy[lock]++;
+        return false;
+    }
+    if (depth[lock]++ == 0) {
+        hist_observe(&local()->lock_wait[lock], 0);
+        held_since[lock] = time_us_32();
+    }
+    return true;
+}
+
+void metrics_unlock(recursive_mutex_t *mtx, metrics_lock_t lock) {
+    if (--depth[lock] > 0) {
+        recursive_mutex_exit(mtx);
+        return;
+    }
+    uint32_t held = time_us_32() - held_since[lock];
+    recursive_mutex_exit(mtx);
+    hist_observe(&local()->lock_hold[lock], held);
+}
+
+void metrics_sd(bool write, uint32_t sectors, uint32_t elapsed_us, bool ok) {
+    core_metrics_t *m = local();
+    m->sd_sectors[write] += sectors;
+    if (!ok) m->sd_errors[write]++;
+    hist_observe(&m->sd_latency[write], elapsed_us);
+}
+
+void metrics_mqtt(metrics_mqtt_result_t result) {
+    local()->mqtt[result]++;
+}
+
+void metrics_mqtt_ack(uint32_t elapsed_us) {
+    hist_observe(&local()->mqtt_ack, elapsed_us);
+}
+
+void metrics_core0_busy(uint32_t elapsed_us) {
+    core0_busy_us += elapsed_us;
+    core0_wakeups++;
+}
+
+void metrics_core0_stats(uint64_t *busy_us, uint32_t *wakeups) {
+    *busy_us = core0_busy_us;
+    *wakeups = core0_wakeups;
+}
+
+void metrics_http_route(uint8_t route, const char *method, const char *path) {
+    if (route < METRICS_HTTP_ROUTES) {
+        route_method[route] = method;
+        route_path[route] = path;
+    }
+}
+
+void metrics_http_request(int route, uint32_t elapsed_us) {
+    if (route < 0 || route >= METRICS_HTTP_ROUTES || !route_path[route]) {
+        route = METRICS_HTTP_ROUTES;
+    }
+    hist_observe(&local()->http[route], elapsed_us);
+}
+
+// ========== Exposition ==========
+// Families are rendered a piece at a time: piece 0 is the HELP/TYPE
+// header, piece 1 + i is series i. A piece is a few hundred bytes at most,
+// so the HTTP side can always fit one into a stream chunk.
+
+#define METRICS_PREFIX "flashtool_"
+
+static bool sink_printf(stream_sink_t *sink, const char *fmt, ...) {
+    char line[256];
+    va_list ap;
+    va_start(ap, fmt);
+    int n = vsnprintf(line, sizeof(line), fmt, ap);
+    va_end(ap);
+    if (n < 0 || (size_t)n >= sizeof(line)) return false;
+    return stream_sink_write(sink, line, (size_t)n);
+}
+
+// Bucket counts summed over both cores, then made cumulative
+static bool write_hist(stream_sink_t *sink, const char *name, const char *labels,
+                       hist_t *(*pick)(core_metrics_t *, uint32_t), uint32_t i) {
+    uint32_t cum = 0;
+    uint64_t sum_us = 0;
+    bool ok = true;
+
+    for (size_t b = 0; b <= METRICS_BUCKETS && ok; b++) {
+        cum += pick(&cores[0], i)->buckets[b] + pick(&cores[1], i)->buckets[b];
+        ok = sink_printf(sink, METRICS_PREFIX "%s_bucket{%s,le=\"%s\"} %lu\n", name, labels,
+                         b < METRICS_BUCKETS ? bucket_le[b] : "+Inf", (unsigned long)cum);
+    }
+    sum_us = pick(&cores[0], i)->sum_us + pick(&cores[1], i)->sum_us;
+    return ok &&
+           sink_printf(sink, METRICS_PREFIX "%s_sum{%s} %llu.%06lu\n", name, labels,
+                       (unsigned long long)(sum_us / 1000000),
+                       (unsigned long)(sum_us % 1000000)) &&
+           sink_printf(sink, METRICS_PREFIX "%s_count{%s} %lu\n", name, labels,
+                       (unsigned long)cum);
+}
+
+static hist_t *pick_lock_wait(core_metrics_t *m, uint32_t i) { return &m->lock_wait[i]; }
+static hist_t *pick_lock_hold(core_metrics_t *m, uint32_t i) { return &m->lock_hold[i]; }
+static hist_t *pick_sd(core_metrics_t *m, uint32_t i) { return &m->sd_latency[i]; }
+static hist_t *pick_http(core_metrics_t *m, uint32_t i) { return &m->http[i]; }
+static hist_t *pick_mqtt_ack(core_metrics_t *m, uint32_t i) { return &m->mqtt_ack; }
+
+// --- Series writers: series i of one family ---
+
+// Opcodes 0x00-0xFF, then "other"; opcodes never seen are skipped
+static bool write_spi(stream_sink_t *sink, const char *name, uint32_t i, bool bytes) {
+    spi_stat_t sum = {0, 0};
+    for (int c = 0; c < 2; c++) {
+        uint8_t slot = (i < 256) ? cores[c].spi_slot[i] : 0;
+        if (slot != 0 || i == 256) {
+            sum.transactions += cores[c].spi[slot].transactions;
+            sum.bytes += cores[c].spi[slot].bytes;
+        }
+    }
+    if (sum.transactions == 0) return true;
+
+    char label[8];
+    if (i < 256) {
+        snprintf(label, sizeof(label), "0x%02X", (unsigned)i);
+    } else {
+        snprintf(label, sizeof(label), "other");
+    }
+    if (bytes) {
+        return sink_printf(sink, METRICS_PREFIX "%s{opcode=\"%s\"} %llu\n", name, label,
+                           (unsigned long long)sum.bytes);
+    }
+    return sink_printf(sink, METRICS_PREFIX "%s{opcode=\"%s\"} %lu\n", name, label,
+                       (unsigned long)sum.transactions);
+}
+
+static bool write_spi_transactions(stream_sink_t *sink, const char *name, uint32_t i) {
+    return write_spi(sink, name, i, false);
+}
+
+static bool write_spi_bytes(stream_sink_t *sink, const char *name, uint32_t i) {
+    return write_spi(sink, name, i, true);
+}
+
+static bool write_lock_wait(stream_sink_t *sink, const char *name, uint32_t i) {
+    char labels[24];
+    snprintf(labels, sizeof(labels), "lock=\"%s\"", lock_names[i]);
+    return write_hist(sink, name, labels, pick_lock_wait, i);
+}
+
+static bool write_lock_hold(stream_sink_t *sink, const char *name, uint32_t i) {
+    char labels[24];
+    snprintf(labels, sizeof(labels), "lock=\"%s\"", lock_names[i]);
+    return write_hist(sink, name, labels, pick_lock_hold, i);
+}
+
+static bool write_lock_busy(stream_sink_t *sink, const char *name, uint32_t i) {
+    return sink_printf(sink, METRICS_PREFIX "%s{lock=\"%s\"} %lu\n", name, lock_names[i],
+                       (unsigned long)(cores[0].lock_busy[i] + cores[1].lock_busy[i]));
+}
+
+static bool write_sd_sectors(stream_sink_t *sink, const char *name, uint32_t i) {
+    return sink_printf(sink, METRICS_PREFIX "%s{op=\"%s\"} %lu\n", name, sd_ops[i],
+                       (unsigned long)(cores[0].sd_sectors[i] + cores[1].sd_sectors[i]));
+}
+
+static bool write_sd_errors(stream_sink_t *sink, const char *name, uint32_t i) {
+    return sink_printf(sink, METRICS_PREFIX "%s{op=\"%s\"} %lu\n", name, sd_ops[i],
+                       (unsigned long)(cores[0].sd_errors[i] + cores[1].sd_errors[i]));
+}
+
+static bool write_sd_latency(stream_sink_t *sink, const char *name, uint32_t i) {
+    char labels[16];
+    snprintf(labels, sizeof(labels), "op=\"%s\"", sd_ops[i]);
+    return write_hist(sink, name, labels, pick_sd, i);
+}
+
+// Registered routes, then "other" (404 / 405 / malformed requests)
+static bool write_http(stream_sink_t *sink, const char *name, uint32_t i) {
+    char labels[64];
+    if (i < METRICS_HTTP_ROUTES) {
+        if (!route_path[i]) return true;
+        snprintf(labels, sizeof(labels), "method=\"%s\",route=\"%s\"", route_method[i],
+                 route_path[i]);
+    } else {
+        snprintf(labels, sizeof(labels), "method=\"\",route=\"other\"");
+    }
+    return write_hist(sink, name, labels, pick_http, i);
+}
+
+static bool write_http_rejected(stream_sink_t *sink, const char *name, uint32_t i) {
+    http_pool_stats_t http;
+    http_server_pool_stats(&http);
+    return sink_printf(sink, METRICS_PREFIX "%s %lu\n", name, (unsigned long)http.rejected);
+}
+
+static bool write_http_in_use(stream_sink_t *sink, const char *name, uint32_t i) {
+    http_pool_stats_t http;
+    http_server_pool_stats(&http);
+    return sink_printf(sink, METRICS_PREFIX "%s %u\n", name, http.in_use);
+}
+
+static bool write_cache(stream_sink_t *sink, const char *name, uint32_t i) {
+    uint32_t hits, misses;
+    flash_cache_stats(&hits, &misses);
+    return sink_printf(sink, METRICS_PREFIX "%s{result=\"%s\"} %lu\n", name,
+                       i == 0 ? "hit" : "miss", (unsigned long)(i == 0 ? hits : misses));
+}
+
+static bool write_mqtt(stream_sink_t *sink, const char *name, uint32_t i) {
+    return sink_printf(sink, METRICS_PREFIX "%s{result=\"%s\"} %lu\n", name, mqtt_results[i],
+                       (unsigned long)(cores[0].mqtt[i] + cores[1].mqtt[i]));
+}
+
+static bool write_mqtt_drops(stream_sink_t *sink, const char *name, uint32_t i) {
+    return sink_printf(sink, METRICS_PREFIX "%s %lu\n", name,
+                       (unsigned long)mqtt_outbox_drops());
+}
+
+static bool write_mqtt_ack(stream_sink_t *sink, const char *name, uint32_t i) {
+    char labels[16];
+    snprintf(labels, sizeof(labels), "qos=\"%d\"", MQTT_PUB_QOS);
+    return write_hist(sink, name, labels, pick_mqtt_ack, i);
+}
+
+static const char *const delivery_results[3] = {"delivered", "retried", "dropped"};
+
+static bool write_mqtt_delivery(stream_sink_t *sink, const char *name, uint32_t i) {
+    mqtt_delivery_stats_t d;
+    mqtt_delivery_stats(&d);
+    const uint32_t counts[3] = {d.delivered, d.retried, d.dropped};
+    return sink_printf(sink, METRICS_PREFIX "%s{result=\"%s\"} %lu\n", name,
+                       delivery_results[i], (unsigned long)counts[i]);
+}
+
+static bool write_mqtt_in_flight(stream_sink_t *sink, const char *name, uint32_t i) {
+    mqtt_delivery_stats_t d;
+    mqtt_delivery_stats(&d);
+    return sink_printf(sink, METRICS_PREFIX "%s %lu\n", name, (unsigned long)d.in_flight);
+}
+
+static const char *const conn_events[4] = {"connect", "connect_failed", "disconnect",
+                                           "dns_lookup"};
+
+static bool write_mqtt_connected(stream_sink_t *sink, const char *name, uint32_t i) {
+    return sink_printf(sink, METRICS_PREFIX "%s %d\n", name, mqtt_is_connected() ? 1 : 0);
+}
+
+static bool write_mqtt_conn_events(stream_sink_t *sink, const char *name, uint32_t i) {
+    mqtt_conn_stats_t c;
+    mqtt_conn_stats(&c);
+    const uint32_t counts[4] = {c.connects, c.connect_failures, c.disconnects, c.dns_lookups};
+    return sink_printf(sink, METRICS_PREFIX "%s{event=\"%s\"} %lu\n", name, conn_events[i],
+                       (unsigned long)counts[i]);
+}
+
+static bool write_journal(stream_sink_t *sink, const char *name, uint32_t i) {
+    uint32_t messages, bytes, drops;
+    journal_stats(&messages, &bytes, &drops);
+    return sink_printf(sink, METRICS_PREFIX "%s{unit=\"%s\"} %lu\n", name,
+                       i == 0 ? "messages" : "bytes",
+                       (unsigned long)(i == 0 ? messages : bytes));
+}
+
+static bool write_journal_drops(stream_sink_t *sink, const char *name, uint32_t i) {
+    uint32_t messages, bytes, drops;
+    journal_stats(&messages, &bytes, &drops);
+    return sink_printf(sink, METRICS_PREFIX "%s %lu\n", name, (unsigned long)drops);
+}
+
+static bool write_uptime(stream_sink_t *sink, const char *name, uint32_t i) {
+    return sink_printf(sink, METRICS_PREFIX "%s %lu\n", name,
+                       (unsigned long)(to_ms_since_boot(get_absolute_time()) / 1000));
+}
+
+// Busy is time in the core0 workers; idle is the rest of uptime
+static bool write_core0(stream_sink_t *sink, const char *name, uint32_t i) {
+    uint64_t us = core0_busy_us;
+    if (i == 1) us = time_us_64() - us;
+    return sink_printf(sink, METRICS_PREFIX "%s{state=\"%s\"} %llu.%06lu\n", name,
+                       i == 0 ? "busy" : "idle", (unsigned long long)(us / 1000000),
+                       (unsigned long)(us % 1000000));
+}
+
+static bool write_core0_wakeups(stream_sink_t *sink, const char *name, uint32_t i) {
+    return sink_printf(sink, METRICS_PREFIX "%s %lu\n", name, (unsigned long)core0_wakeups);
+}
+
+typedef struct {
+    const char *name;
+    const char *type;
+    const char *help;
+    uint32_t series;
+    bool (*write)(stream_sink_t *sink, const char *name, uint32_t i);
+} metrics_family_t;
+
+static const metrics_family_t families[] = {
+    {"uptime_seconds", "gauge", "Time since boot.", 1, write_uptime},
+    {"core0_seconds_total", "counter", "core0 time in the event loop workers vs asleep.", 2,
+     write_core0},
+    {"core0_wakeups_total", "counter", "core0 event loop worker runs.", 1, write_core0_wakeups},
+    {"spi_transactions_total", "counter", "Target flash SPI transactions by opcode.", 257,
+     write_spi_transactions},
+    {"spi_bytes_total", "counter", "Target flash SPI bytes on the wire by opcode.", 257,
+     write_spi_bytes},
+    {"lock_wait_seconds", "histogram", "Time spent waiting for a mutex.", METRICS_LOCK_COUNT,
+     write_lock_wait},
+    {"lock_hold_seconds", "histogram", "Time a mutex was held.", METRICS_LOCK_COUNT,
+     write_lock_hold},
+    {"lock_busy_total", "counter", "Non-blocking lock attempts that found the mutex taken.",
+     METRICS_LOCK_COUNT, write_lock_busy},
+    {"sd_sectors_total", "counter", "SD card sectors transferred.", 2, write_sd_sectors},
+    {"sd_errors_total", "counter", "Failed SD card sector transfers.", 2, write_sd_errors},
+    {"sd_latency_seconds", "histogram", "SD card disk_read / disk_write latency.", 2,
+     write_sd_latency},
+    {"http_request_duration_seconds", "histogram",
+     "HTTP request latency, parsed request to last byte queued.", METRICS_HTTP_ROUTES + 1,
+     write_http},
+    {"http_connections_in_use", "gauge", "HTTP connection slots in use.", 1, write_http_in_use},
+    {"http_connections_rejected_total", "counter", "Connections refused, no free slot.", 1,
+     write_http_rejected},
+    {"flash_cache_lookups_total", "counter", "Hex viewer sector cache lookups.", 2,
+     write_cache},
+    {"mqtt_publishes_total", "counter", "MQTT publish attempts by result.", METRICS_MQTT_COUNT,
+     write_mqtt},
+    {"mqtt_puback_seconds", "histogram", "Publish to broker acknowledgement.", 1,
+     write_mqtt_ack},
+    {"mqtt_deliveries_total", "counter",
+     "Publishes acknowledged, failed and sent again, or failed and given up on.", 3,
+     write_mqtt_delivery},
+    {"mqtt_in_flight", "gauge", "Publishes waiting for an acknowledgement.", 1,
+     write_mqtt_in_flight},
+    {"mqtt_outbox_drops_total", "counter", "Messages dropped because the outbox was full.", 1,
+     write_mqtt_drops},
+    {"mqtt_connected", "gauge", "1 while the broker connection is up.", 1,
+     write_mqtt_connected},
+    {"mqtt_connection_events_total", "counter",
+     "Broker connects, failed attempts, drops and DNS lookups.", 4, write_mqtt_conn_events},
+    {"mqtt_journal_pending", "gauge", "Offline messages waiting in the SD journal.", 2,
+     write_journal},
+    {"mqtt_journal_drops_total", "counter", "Messages lost because the journal was full.", 1,
+     write_journal_drops},
+};
+
+#define NUM_FAMILIES (sizeof(families) / sizeof(families[0]))
+
+uint32_t metrics_piece_count(void) {
+    uint32_t n = 0;
+    for (size_t f = 0; f < NUM_FAMILIES; f++) {
+        n += 1 + families[f].series;
+    }
+    return n;
+}
+
+bool metrics_write_piece(stream_sink_t *sink, uint32_t index) {
+    for (size_t f = 0; f < NUM_FAMILIES; f++) {
+        const metrics_family_t *fam = &families[f];
+        if (index > fam->series) {
+            index -= fam->series + 1;
+            continue;
+        }
+        if (index == 0) {
+            return sink_printf(sink, "# HELP " METRICS_PREFIX "%s %s\n# TYPE " METRICS_PREFIX
+                               "%s %s\n", fam->name, fam->help, fam->name, fam->type);
+        }
+        return fam->write(sink, fam->name, index - 1);
+    }
+    return true; // Past the end: nothing to write
+}
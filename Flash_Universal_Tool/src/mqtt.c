@@ -1,7 +1,17 @@
 #include "mqtt.h"
 #include "config.h" 
+#include "metrics.h"
+#include "globals.h"
+#include "crc32.h"
+#include "sd_card.h"
+#include "mqtt_journal.h"
+#include "mqtt_cmd.h"
 #include "lwip/apps/mqtt.h"
 #include "lwip/dns.h"
+#include "pico/cyw43_arch.h"
+#include "pico/rand.h"
+#include "pico/stdlib.h"
+#include "pico/util/queue.h"
 #include <string.h>
 #include <stdio.h>
 
@@ -10,82 +20,757 @@ static mqtt_client_t *mqtt_client;
 static ip_addr_t mqtt_broker_ip;
 static volatile bool mqtt_connected = false;
 
-// Callback: Connection Status
+// Outbox: lets core1 hand messages to core0, which owns lwIP
+typedef struct {
+    char topic[48];
+    char payload[MQTT_OUTBOX_PAYLOAD];
+} mqtt_outbox_msg_t;
+
+static queue_t mqtt_outbox;
+static uint32_t mqtt_outbox_dropped = 0;
+
+static void pub_abort(void); // File Publish, below
+static void pub_sent_cb(uint32_t id, err_t result);
+static void replay_sent_cb(uint32_t gen, err_t result); // Journal Replay, below
+static bool journal_msg(const mqtt_outbox_msg_t *msg); // Outbox, below
+
+// ========== Delivery Window ==========
+// Every publish (outbox message, journal record or report chunk) holds one
+// of MQTT_PUB_WINDOW slots from mqtt_publish until the broker acknowledges
+// it: a PUBACK at QoS 1 (MQTT_PUB_QOS), TCP's ACK at QoS 0. The service
+// pass refills a slot as soon as it frees up, so a window's worth of
+// messages share each round trip. The client gives up on a PUBACK after
+// MQTT_REQ_TIMEOUT (lwipopts.h); a dropped connection discards whatever
+// was outstanding without any callback, so window_reset ends those.
+//
+// Outbox messages keep their copy in the slot until acknowledged. A failed
+// one goes into the journal, or without an SD card out again, up to
+// MQTT_PUB_RETRIES tries. Journal records and report chunks are on SD
+// already; their owners rewind and send them again.
+
+typedef enum { SLOT_FREE = 0, SLOT_SENT, SLOT_RESEND } slot_state_t;
+typedef enum { OWNER_LIVE = 0, OWNER_REPLAY, OWNER_CHUNK } slot_owner_t;
+
+typedef struct {
+    uint8_t state;
+    uint8_t owner;
+    uint8_t tries;
+    uint32_t tag;     // Owner's generation / publish id, handed back on completion
+    uint32_t ticket;  // Callback argument; stale callbacks don't match
+    uint32_t sent_us;
+} window_slot_t;
+
+static window_slot_t window[MQTT_PUB_WINDOW];
+static mqtt_outbox_msg_t live_msgs[MQTT_PUB_WINDOW]; // Copies of OWNER_LIVE messages
+static uint32_t window_tickets = 0;
+static mqtt_delivery_stats_t delivery;
+
+// Index of a free slot, or -1 (an acknowledgement will wake the service pass)
+static int window_free(void) {
+    for (int i = 0; i < MQTT_PUB_WINDOW; i++) {
+        if (window[i].state == SLOT_FREE) return i;
+    }
+    return -1;
+}
+
+static void window_failed(window_slot_t *s) {
+    s->tries++;
+    if (s->owner != OWNER_LIVE) {
+        delivery.retried++; // Still on SD
+        s->state = SLOT_FREE;
+    } else if (sd_ready || s->tries < MQTT_PUB_RETRIES) {
+        delivery.retried++;
+        s->state = SLOT_RESEND; // Journaled or sent again by the service pass
+    } else {
+        printf("✗ MQTT message to %s dropped after %u tries\n",
+               live_msgs[s - window].topic, s->tries);
+        delivery.dropped++;
+        s->state = SLOT_FREE;
+    }
+    delivery.in_flight--;
+}
+
+// lwIP: PUBACK (or sent, at QoS 0), or ERR_TIMEOUT when none came
+static void window_cb(void *arg, err_t result) {
+    uint32_t ticket = (uint32_t)(uintptr_t)arg;
+    window_slot_t *s = &window[ticket % MQTT_PUB_WINDOW];
+    if (s->ticket != ticket || s->state != SLOT_SENT) {
+        return; // Ended by window_reset already
+    }
+
+    if (result == ERR_OK) {
+        uint32_t us = time_us_32() - s->sent_us;
+        delivery.delivered++;
+        delivery.in_flight--;
+        delivery.ack_us_sum += us;
+        if (us > delivery.ack_us_max) delivery.ack_us_max = us;
+        metrics_mqtt_ack(us);
+        s->state = SLOT_FREE;
+    } else {
+        printf("✗ MQTT publish not acknowledged (Err: %d)\n", result);
+        window_failed(s);
+    }
+
+    if (s->owner == OWNER_REPLAY) {
+        replay_sent_cb(s->tag, result);
+    } else if (s->owner == OWNER_CHUNK) {
+        pub_sent_cb(s->tag, result);
+    }
+    core0_wake(); // A slot is free (or a message waits to go again)
+}
+
+// Connection lost: nothing outstanding will be acknowledged now
+static void window_reset(void) {
+    for (int i = 0; i < MQTT_PUB_WINDOW; i++) {
+        if (window[i].state == SLOT_SENT) window_failed(&window[i]);
+    }
+}
+
+// Publish into slot i. ERR_MEM if the client's output ring or request
+// slots are full: the slot stays as it was, try again on a later pass.
+static err_t window_publish(int i, slot_owner_t owner, uint32_t tag, const char *topic,
+                            const void *data, size_t len) {
+    window_slot_t *s = &window[i];
+    uint32_t ticket = ++window_tickets * MQTT_PUB_WINDOW + i;
+
+    cyw43_arch_lwip_begin();
+    err_t err = mqtt_publish(mqtt_client, topic, data, len, MQTT_PUB_QOS, 0, window_cb,
+                             (void *)(uintptr_t)ticket);
+    cyw43_arch_lwip_end();
+
+    if (err == ERR_MEM) {
+        metrics_mqtt(METRICS_MQTT_RETRY);
+        return err;
+    }
+    metrics_mqtt(err == ERR_OK ? METRICS_MQTT_OK : METRICS_MQTT_ERROR);
+    if (err == ERR_OK) {
+        if (s->state != SLOT_RESEND) s->tries = 0;
+        s->state = SLOT_SENT;
+        s->owner = owner;
+        s->tag = tag;
+        s->ticket = ticket;
+        s->sent_us = time_us_32();
+        delivery.in_flight++;
+    }
+    return err;
+}
+
+// Outbox messages that weren't acknowledged: into the journal, or out
+// again. True if it has to be called again without a callback to prompt it.
+static bool live_resend(void) {
+    for (int i = 0; i < MQTT_PUB_WINDOW; i++) {
+        window_slot_t *s = &window[i];
+        if (s->state != SLOT_RESEND) continue;
+        const mqtt_outbox_msg_t *msg = &live_msgs[i];
+
+        if (sd_ready) {
+            if (!journal_msg(msg)) return true;
+            s->state = SLOT_FREE;
+            continue;
+        }
+        if (!mqtt_connected) continue; // Waits for the reconnect, like the outbox
+
+        err_t err = window_publish(i, OWNER_LIVE, 0, msg->topic, msg->payload,
+                                   strlen(msg->payload));
+        if (err == ERR_MEM) return true;
+        if (err != ERR_OK) {
+            printf("✗ MQTT Publish to %s failed (Err: %d)\n", msg->topic, err);
+            delivery.dropped++;
+            s->state = SLOT_FREE;
+        }
+    }
+    return false;
+}
+
+// ========== Journal Replay State ==========
+// After a reconnect the SD journal goes out oldest first, ahead of anything
+// new (which is appended behind it meanwhile). At most MQTT_REPLAY_WINDOW
+// of its messages are unacknowledged, one sent every MQTT_REPLAY_INTERVAL_MS
+// so the backlog doesn't crowd out live traffic. Acknowledgements move the
+// persisted cursor; any failure rewinds to the last delivered record, so
+// delivery is at-least-once.
+
+static struct {
+    uint32_t gen;       // Bumped on rewind; callbacks from before are ignored
+    uint32_t sent;      // Journal offset of the next record to publish
+    uint32_t acked;     // Records before this offset were delivered
+    uint32_t delivered; // Records delivered since the last journal_commit
+    uint32_t ends[MQTT_REPLAY_WINDOW]; // In flight, oldest first
+    uint8_t head;
+    uint8_t in_flight;
+    uint32_t last_ms;
+} replay;
+
+static void replay_rewind(void) {
+    replay.gen++;
+    replay.head = 0;
+    replay.in_flight = 0;
+    replay.sent = replay.acked;
+}
+
+static void replay_delivered(uint32_t end) {
+    replay.acked = end;
+    replay.delivered++;
+    core0_wake(); // Commit it and send the next one
+}
+
+// ========== Connection Manager ==========
+// Connects at startup and after any drop reconnects on its own, backing off
+// exponentially (MQTT_BACKOFF_MIN_MS doubling up to MQTT_BACKOFF_MAX_MS, with
+// jitter so a bench of devices doesn't reconnect in lockstep). The broker
+// address from the last DNS lookup is reused; it is looked up again every
+// MQTT_DNS_RETRY_FAILS failed attempts in a row. A dead broker or path is
+// caught by the client's keep-alive (MQTT_KEEPALIVE_S), a hanging connect
+// by MQTT_CONNECT_TIMEOUT_MS, and a dropped Wi-Fi link is rejoined first.
+
+static mqtt_conn_state_t conn_state = MQTT_STATE_IDLE;
+static bool have_ip = false;
+static uint32_t failures = 0; // Attempts in a row that didn't end connected
+static mqtt_conn_stats_t conn_stats;
+static async_at_time_worker_t conn_worker; // Backoff / connect timeout
+static char client_id[32];
+
+// ========== Incoming Commands ==========
+// A message arrives as a publish callback (topic, total length) followed by
+// one or more data callbacks; the command is handed on once complete.
+
+static char cmd_buf[MQTT_CMD_MAX + 1];
+static size_t cmd_len;
+static bool cmd_too_long;
+
+static void mqtt_incoming_publish_cb(void *arg, const char *topic, uint32_t tot_len) {
+    cmd_len = 0;
+    cmd_too_long = (tot_len > MQTT_CMD_MAX);
+    if (cmd_too_long) {
+        printf("✗ MQTT command on %s too long (%lu bytes)\n", topic, (unsigned long)tot_len);
+    }
+}
+
+static void mqtt_incoming_data_cb(void *arg, const uint8_t *data, uint16_t len, uint8_t flags) {
+    if (!cmd_too_long && cmd_len + len <= MQTT_CMD_MAX) {
+        memcpy(cmd_buf + cmd_len, data, len);
+        cmd_len += len;
+    }
+    if ((flags & MQTT_DATA_FLAG_LAST) && !cmd_too_long) {
+        cmd_buf[cmd_len] = '\0';
+        mqtt_cmd_receive(cmd_buf, cmd_len);
+    }
+}
+
+static void subscribe_commands(void) {
+    for (int fleet = 0; fleet < 2; fleet++) {
+        err_t err = mqtt_subscribe(mqtt_client, mqtt_cmd_topic(fleet), 0, NULL, NULL);
+        if (err != ERR_OK) {
+            printf("✗ MQTT subscribe to %s failed (Err: %d)\n", mqtt_cmd_topic(fleet), err);
+        }
+    }
+}
+
+static void conn_timer(uint32_t ms) {
+    async_context_t *ctx = cyw43_arch_async_context();
+    async_context_remove_at_time_worker(ctx, &conn_worker);
+    async_context_add_at_time_worker_in_ms(ctx, &conn_worker, ms);
+}
+
+static void schedule_reconnect(void) {
+    uint32_t delay = MQTT_BACKOFF_MAX_MS;
+    if (failures < 16 && (MQTT_BACKOFF_MIN_MS << failures) < MQTT_BACKOFF_MAX_MS) {
+        delay = MQTT_BACKOFF_MIN_MS << failures;
+    }
+    delay = delay / 2 + get_rand_32() % (delay / 2 + 1); // Somewhere in [d/2, d]
+    failures++;
+    conn_state = MQTT_STATE_BACKOFF;
+    conn_stats.backoff_ms = delay;
+    printf("MQTT: retry %lu in %lu ms\n", (unsigned long)failures, (unsigned long)delay);
+    conn_timer(delay);
+}
+
+// lwIP: CONNACK, refusal, or the connection died (keep-alive timeout, TCP error)
 static void mqtt_connection_cb(mqtt_client_t *client, void *arg, mqtt_connection_status_t status) {
     if (status == MQTT_CONNECT_ACCEPTED) {
         printf("✓ MQTT Connected!\n");
+        async_context_remove_at_time_worker(cyw43_arch_async_context(), &conn_worker);
+        conn_state = MQTT_STATE_CONNECTED;
+        conn_stats.connects++;
+        failures = 0;
         mqtt_connected = true;
+        subscribe_commands(); // Clean session: subscriptions don't survive a reconnect
+        replay_rewind();
+        core0_wake(); // Replay the journal, flush the outbox
+        return;
+    }
+
+    // A refused CONNACK comes in twice: with the refusal code, then again
+    // from the client closing the connection. Count the attempt once.
+    if (conn_state == MQTT_STATE_BACKOFF) {
+        return;
+    }
+
+    if (conn_state == MQTT_STATE_CONNECTED) {
+        printf("✗ MQTT connection lost (Status: %d)\n", status);
+        conn_stats.disconnects++;
     } else {
         printf("✗ MQTT connection failed (Status: %d)\n", status);
-        mqtt_connected = false;
+        conn_stats.connect_failures++;
     }
+    mqtt_connected = false;
+    window_reset();
+    pub_abort();
+    replay_rewind(); // Unconfirmed records go again after reconnecting
+    schedule_reconnect();
+}
+
+static void connect_broker(void) {
+    struct mqtt_connect_client_info_t ci;
+    memset(&ci, 0, sizeof(ci));
+    
+    // Unique per board: the broker drops the older of two equal client ids
+    ci.client_id = client_id;
+    ci.keep_alive = MQTT_KEEPALIVE_S;
+
+    conn_state = MQTT_STATE_CONNECTING;
+    err_t err = mqtt_client_connect(mqtt_client, &mqtt_broker_ip, MQTT_PORT,
+                                    mqtt_connection_cb, NULL, &ci);
+    if (err != ERR_OK) {
+        printf("✗ MQTT connect failed to start (Err: %d)\n", err);
+        conn_stats.connect_failures++;
+        schedule_reconnect();
+        return;
+    }
+    conn_timer(MQTT_CONNECT_TIMEOUT_MS);
 }
 
 // Callback: DNS Found
 static void mqtt_dns_found(const char *hostname, const ip_addr_t *ipaddr, void *arg) {
     if (ipaddr != NULL) {
         mqtt_broker_ip = *ipaddr;
+        have_ip = true;
         printf("✓ DNS resolved %s to %s\n", hostname, ip4addr_ntoa(ipaddr));
+    } else {
+        printf("✗ DNS failed for %s%s\n", hostname, have_ip ? ", using the cached address" : "");
+    }
 
-        struct mqtt_connect_client_info_t ci;
-        memset(&ci, 0, sizeof(ci));
-        
-        // You might want to move "pico_spi_flash_tool" to config.h eventually
-        ci.client_id = "pico_spi_flash_tool_v2"; 
-        ci.keep_alive = 60;
-
-        mqtt_client_connect(mqtt_client, &mqtt_broker_ip, MQTT_PORT,
-                            mqtt_connection_cb, NULL, &ci);
+    if (have_ip) {
+        connect_broker();
     } else {
-        printf("✗ DNS failed for %s\n", hostname);
+        conn_stats.connect_failures++;
+        schedule_reconnect();
     }
 }
 
-// Public: Initialize
-void mqtt_init(void) {
-    printf("\n--- Initializing MQTT ---\n");
-    mqtt_client = mqtt_client_new();
-    
-    if (!mqtt_client) {
-        printf("✗ Failed to create MQTT client struct\n");
+static void start_connect(void) {
+    // Nothing gets through until the Wi-Fi link (and its DHCP lease) is back
+    int link = cyw43_tcpip_link_status(&cyw43_state, CYW43_ITF_STA);
+    if (link != CYW43_LINK_UP) {
+        if (link != CYW43_LINK_JOIN && link != CYW43_LINK_NOIP) {
+            printf("MQTT: Wi-Fi down (%d), rejoining %s\n", link, WIFI_SSID);
+            cyw43_arch_wifi_connect_async(WIFI_SSID, WIFI_PASSWORD, CYW43_AUTH_WPA2_AES_PSK);
+        }
+        schedule_reconnect();
+        return;
+    }
+
+    if (have_ip && (failures == 0 || failures % MQTT_DNS_RETRY_FAILS != 0)) {
+        connect_broker();
         return;
     }
 
-    // Start DNS resolution
+    conn_state = MQTT_STATE_RESOLVING;
+    conn_stats.dns_lookups++;
     err_t err = dns_gethostbyname(MQTT_BROKER, &mqtt_broker_ip, mqtt_dns_found, NULL);
-    
     if (err == ERR_OK) {
         // IP was already in cache, call callback immediately
         mqtt_dns_found(MQTT_BROKER, &mqtt_broker_ip, NULL);
     } else if (err != ERR_INPROGRESS) {
         printf("✗ DNS request failed\n");
+        mqtt_dns_found(MQTT_BROKER, NULL, NULL);
     }
 }
 
-// Public: Publish
-bool mqtt_publish_report(const char *json_data) {
-    if (!mqtt_connected || !mqtt_client) {
-        return false;
+// Backoff over, or a connect attempt that never got an answer
+static void conn_work(async_context_t *ctx, async_at_time_worker_t *worker) {
+    if (conn_state == MQTT_STATE_CONNECTING) {
+        printf("✗ MQTT connect timed out\n");
+        mqtt_disconnect(mqtt_client); // Closes without calling mqtt_connection_cb
+        conn_stats.connect_failures++;
+        schedule_reconnect();
+    } else if (conn_state == MQTT_STATE_BACKOFF) {
+        start_connect();
     }
+}
 
-    size_t data_len = strlen(json_data);
+// Public: Initialize
+void mqtt_init(void) {
+    printf("\n--- Initializing MQTT ---\n");
+    queue_init(&mqtt_outbox, sizeof(mqtt_outbox_msg_t), MQTT_OUTBOX_DEPTH);
+    if (sd_ready) {
+        journal_init(); // Messages left from before the reboot replay first
+        replay.sent = replay.acked = journal_cursor();
+    }
+    mqtt_client = mqtt_client_new();
     
-    // MQTT buffer limitation safety
-    if (data_len > 4096) {
-        printf("⚠️ Truncating MQTT message to 4096 bytes\n");
-        data_len = 4096;
+    if (!mqtt_client) {
+        printf("✗ Failed to create MQTT client struct\n");
+        return;
     }
 
-    err_t err = mqtt_publish(mqtt_client, MQTT_TOPIC, json_data, data_len, 
-                             0, 0, NULL, NULL); // QoS 0, Retain 0
+    mqtt_cmd_init();
+    snprintf(client_id, sizeof(client_id), "flashtool-%s", mqtt_cmd_device_id());
+    mqtt_set_inpub_callback(mqtt_client, mqtt_incoming_publish_cb, mqtt_incoming_data_cb,
+                            NULL);
 
-    if (err == ERR_OK) {
-        printf("✓ Published report (%d bytes)\n", (int)data_len);
-        return true;
+    conn_worker.do_work = conn_work;
+    cyw43_arch_lwip_begin();
+    start_connect();
+    cyw43_arch_lwip_end();
+}
+
+void mqtt_conn_stats(mqtt_conn_stats_t *out) {
+    *out = conn_stats;
+    out->state = conn_state;
+}
+
+void mqtt_delivery_stats(mqtt_delivery_stats_t *out) {
+    *out = delivery;
+}
+
+// ========== File Publish ==========
+// A report goes out straight from its SD file, one piece per publish-complete
+// callback, so neither its size nor the 2 KB output ring limits it. Files up
+// to MQTT_CHUNK_SIZE are one plain message on the topic. Larger ones are
+// numbered chunks on <topic>/chunk, each a one-line JSON header, '\n', then
+// the raw bytes:
+//   {"id":7,"i":0,"n":9,"len":9000,"crc":"1A2B3C4D"}
+// crc covers this chunk; the last one adds "sum", the CRC of the whole file.
+// tools/mqtt_reassemble.py puts them back together.
+// Large journal records go out the same way, from their place in the journal.
+
+#define CHUNK_HEADER_MAX 96
+
+static struct {
+    bool active;
+    bool replay;        // A journal record, not a live report
+    bool requeue;       // Live report failed: copy it into the journal
+    char file[13];
+    char base_topic[48];
+    char topic[48];
+    uint32_t id;
+    uint32_t base;      // File offset of the first byte
+    uint32_t size;
+    uint32_t next;      // Offset (from base) of the next chunk
+    uint32_t record_end;
+    uint16_t index;
+    uint16_t count;
+    uint32_t sum;       // Running CRC of the bytes sent so far
+    uint8_t in_flight;  // Published, not acknowledged yet
+} pub;
+
+static uint32_t pub_seq = 0;
+static uint8_t chunk_buf[CHUNK_HEADER_MAX + MQTT_CHUNK_SIZE];
+
+static void pub_start(const char *topic, const char *file, uint32_t base, uint32_t size) {
+    memset(&pub, 0, sizeof(pub));
+    strncpy(pub.file, file, sizeof(pub.file) - 1);
+    strncpy(pub.base_topic, topic, sizeof(pub.base_topic) - 1);
+    pub.base = base;
+    pub.size = size;
+    pub.count = (uint16_t)((size + MQTT_CHUNK_SIZE - 1) / MQTT_CHUNK_SIZE);
+    snprintf(pub.topic, sizeof(pub.topic), pub.count > 1 ? "%s/chunk" : "%s", topic);
+    if (pub_seq == 0) pub_seq = time_us_32(); // Different ids after a reboot
+    pub.id = ++pub_seq;
+    pub.active = true;
+}
+
+static void pub_finish(bool ok) {
+    if (ok) {
+        printf("✓ Published %s to %s (%lu bytes, %u message%s)\n",
+               pub.replay ? "journal record" : pub.file, pub.topic,
+               (unsigned long)pub.size, pub.count, pub.count == 1 ? "" : "s");
     } else {
-        printf("✗ MQTT Publish failed (Err: %d)\n", err);
+        printf("✗ MQTT publish of %s aborted at chunk %u/%u\n",
+               pub.replay ? "journal record" : pub.file, pub.index, pub.count);
+    }
+    pub.active = false;
+
+    if (pub.replay) {
+        if (ok) {
+            replay_delivered(pub.record_end);
+        } else {
+            replay_rewind();
+        }
+    } else if (!ok && sd_ready) {
+        pub.requeue = true;
+        core0_wake();
+    }
+}
+
+// Chunks already sent can't be resumed on a new connection
+static void pub_abort(void) {
+    if (pub.active) pub_finish(false);
+}
+
+// Window: a chunk was acknowledged, or it never will be
+static void pub_sent_cb(uint32_t id, err_t result) {
+    if (!pub.active || id != pub.id) {
+        return; // Left over from an aborted publish
+    }
+    pub.in_flight--;
+    if (result != ERR_OK) {
+        pub_finish(false);
+    } else if (pub.next == pub.size && pub.in_flight == 0) {
+        pub_finish(true);
+    }
+}
+
+// Queue chunks while the window has room. True if it has to be called
+// again without a callback to prompt it (SD busy or output ring full).
+static bool pub_pump(void) {
+    int slot;
+    while (pub.active && mqtt_connected && pub.next < pub.size &&
+           pub.in_flight < MQTT_CHUNKS_IN_FLIGHT && (slot = window_free()) >= 0) {
+        // Never block lwIP on the SD card: another core may be writing it
+        if (!sd_try_lock()) return true;
+        uint32_t len = pub.size - pub.next;
+        if (len > MQTT_CHUNK_SIZE) len = MQTT_CHUNK_SIZE;
+        uint8_t *data = chunk_buf + CHUNK_HEADER_MAX;
+        // The journal only grows, but a report can be rewritten by a new scan
+        bool same = pub.replay || (sd_file_size_safe(pub.file) == (int32_t)pub.size);
+        int n = same ? sd_read_binary_safe(pub.file, pub.base + pub.next, data, len) : -1;
+        sd_unlock();
+
+        if (n != (int)len) {
+            printf("✗ %s changed or unreadable during MQTT publish\n", pub.file);
+            pub_finish(false);
+            return false;
+        }
+
+        uint8_t *msg = data;
+        size_t msg_len = len;
+        uint32_t sum = crc32_update(pub.sum, data, len);
+        if (pub.count > 1) {
+            char header[CHUNK_HEADER_MAX];
+            int h = snprintf(header, sizeof(header),
+                             "{\"id\":%lu,\"i\":%u,\"n\":%u,\"len\":%lu,\"crc\":\"%08lX\"",
+                             (unsigned long)pub.id, pub.index, pub.count,
+                             (unsigned long)pub.size,
+                             (unsigned long)crc32_update(0, data, len));
+            if (pub.index + 1 == pub.count) {
+                h += snprintf(header + h, sizeof(header) - h, ",\"sum\":\"%08lX\"",
+                              (unsigned long)sum);
+            }
+            h += snprintf(header + h, sizeof(header) - h, "}\n");
+            msg = data - h;
+            memcpy(msg, header, h);
+            msg_len += h;
+        }
+
+        err_t err = window_publish(slot, OWNER_CHUNK, pub.id, pub.topic, msg, msg_len);
+        if (err == ERR_MEM) {
+            return true; // Ring or request slots full; the data is re-read next time
+        }
+        if (err != ERR_OK) {
+            printf("✗ MQTT Publish to %s failed (Err: %d)\n", pub.topic, err);
+            pub_finish(false);
+            return false;
+        }
+        pub.sum = sum;
+        pub.next += len;
+        pub.index++;
+        pub.in_flight++;
+    }
+    return false;
+}
+
+// A live report that failed part way goes into the journal whole
+static bool pub_requeue(void) {
+    if (!pub.requeue) return false;
+    if (!sd_try_lock()) return true;
+    if (journal_append_file(pub.base_topic, pub.file)) {
+        printf("MQTT: %s queued in the journal\n", pub.file);
+    }
+    pub.requeue = false;
+    sd_unlock();
+    return false;
+}
+
+// Public: Publish a report file from SD (core0)
+bool mqtt_publish_file(const char *topic, const char *file) {
+    if (!mqtt_client || mqtt_publish_busy()) {
         return false;
     }
+
+    // Offline, or older messages still waiting: go in the journal behind them
+    if (!mqtt_connected || journal_pending()) {
+        return journal_append_file(topic, file);
+    }
+
+    int32_t size = sd_file_size_safe(file);
+    if (size <= 0) {
+        return false;
+    }
+    pub_start(topic, file, 0, (uint32_t)size);
+    core0_wake(); // The service pass sends the chunks
+    return true;
+}
+
+bool mqtt_publish_busy(void) {
+    return pub.active || pub.requeue;
+}
+
+// ========== Journal Replay ==========
+
+// Window: a replayed message was acknowledged, or it never will be. The
+// broker acknowledges QoS 1 publishes in the order they were sent.
+static void replay_sent_cb(uint32_t gen, err_t result) {
+    if (gen != replay.gen) {
+        return; // Sent before a rewind
+    }
+    if (result != ERR_OK) {
+        replay_rewind();
+        return;
+    }
+    uint32_t end = replay.ends[replay.head];
+    replay.head = (replay.head + 1) % MQTT_REPLAY_WINDOW;
+    replay.in_flight--;
+    replay_delivered(end);
+}
+
+// Commit what was delivered and publish the next records. True if it has
+// to be called again without a callback to prompt it.
+static bool replay_pump(void) {
+    if (!journal_pending() && replay.delivered == 0) return false;
+    if (!sd_try_lock()) return true;
+
+    if (replay.delivered > 0) {
+        journal_commit(replay.acked, replay.delivered);
+        replay.delivered = 0;
+        if (!journal_pending()) {
+            replay.sent = replay.acked = journal_cursor(); // File emptied
+        }
+    }
+
+    bool again = false;
+    uint32_t now = to_ms_since_boot(get_absolute_time());
+    journal_record_t rec;
+    int slot;
+    while (mqtt_connected && !pub.active && replay.in_flight < MQTT_REPLAY_WINDOW &&
+           (slot = window_free()) >= 0 && journal_read(replay.sent, &rec)) {
+        if (now - replay.last_ms < MQTT_REPLAY_INTERVAL_MS) {
+            again = true; // Rate limit
+            break;
+        }
+
+        if (rec.len > MQTT_CHUNK_SIZE) {
+            // Chunked like a report, once the records ahead of it are delivered
+            if (replay.in_flight == 0) {
+                pub_start(rec.topic, MQTT_JOURNAL_FILE, rec.offset, rec.len);
+                pub.replay = true;
+                pub.record_end = rec.next;
+                replay.sent = rec.next;
+                replay.last_ms = now;
+            }
+            break;
+        }
+
+        if (journal_read_payload(rec.offset, chunk_buf, rec.len) != (int)rec.len) {
+            again = true;
+            break;
+        }
+        err_t err = window_publish(slot, OWNER_REPLAY, replay.gen, rec.topic, chunk_buf,
+                                   rec.len);
+        if (err == ERR_MEM) {
+            again = true;
+            break;
+        }
+        if (err != ERR_OK) {
+            again = true; // Left in the journal; tried again next pass
+            break;
+        }
+        replay.ends[(replay.head + replay.in_flight) % MQTT_REPLAY_WINDOW] = rec.next;
+        replay.in_flight++;
+        replay.sent = rec.next;
+        replay.last_ms = now;
+    }
+
+    sd_unlock();
+    return again;
+}
+
+// ========== Outbox ==========
+
+bool mqtt_enqueue(const char *topic, const char *payload) {
+    mqtt_outbox_msg_t msg;
+    strncpy(msg.topic, topic, sizeof(msg.topic) - 1);
+    msg.topic[sizeof(msg.topic) - 1] = '\0';
+    strncpy(msg.payload, payload, sizeof(msg.payload) - 1);
+    msg.payload[sizeof(msg.payload) - 1] = '\0';
+
+    if (!queue_try_add(&mqtt_outbox, &msg)) {
+        mqtt_outbox_dropped++;
+        return false;
+    }
+    core0_wake();
+    return true;
+}
+
+// Move one message into the journal; false if the SD card is busy
+static bool journal_msg(const mqtt_outbox_msg_t *msg) {
+    if (!sd_try_lock()) return false;
+    journal_append(msg->topic, msg->payload, strlen(msg->payload)); // Full: counted there
+    sd_unlock();
+    return true;
+}
+
+// Public: Drain outbox (core0 only)
+bool mqtt_service(void) {
+    mqtt_outbox_msg_t msg;
+    bool again = pub_requeue();
+
+    // Results of jobs started from the command topic
+    mqtt_cmd_service();
+
+    // Unacknowledged messages are older than anything in the outbox
+    if (live_resend()) again = true;
+
+    // Offline, or the journal still replaying: new messages queue behind it
+    while (sd_ready && (!mqtt_connected || journal_pending()) &&
+           queue_try_peek(&mqtt_outbox, &msg)) {
+        if (!journal_msg(&msg)) {
+            again = true;
+            break;
+        }
+        queue_try_remove(&mqtt_outbox, &msg);
+    }
+
+    int slot;
+    while (mqtt_connected && !journal_pending() && (slot = window_free()) >= 0 &&
+           queue_try_peek(&mqtt_outbox, &live_msgs[slot])) {
+        const mqtt_outbox_msg_t *m = &live_msgs[slot];
+        err_t err = window_publish(slot, OWNER_LIVE, 0, m->topic, m->payload,
+                                   strlen(m->payload));
+        if (err == ERR_MEM) {
+            again = true; // Output ring buffer full, retry on the next pass
+            break;
+        }
+        if (err != ERR_OK) {
+            printf("✗ MQTT Publish to %s failed (Err: %d)\n", m->topic, err);
+            if (!sd_ready) {
+                delivery.dropped++;
+            } else if (!journal_msg(m)) {
+                again = true; // Journal it next pass
+                break;
+            }
+        }
+        queue_try_remove(&mqtt_outbox, &msg);
+    }
+
+    if (replay_pump()) again = true;
+    if (pub_pump()) again = true;
+    return again;
+}
+
+uint32_t mqtt_outbox_drops(void) {
+    return mqtt_outbox_dropped;
 }
 
 // Public: Status Getter
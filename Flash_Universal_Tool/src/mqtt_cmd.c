@@ -0,0 +1,202 @@
+#include "mqtt_cmd.h"
+#include "mqtt.h"
+#include "jobs.h"
+#include "globals.h"
+#include "config.h"
+#include "pico/stdlib.h"
+#include "pico/unique_id.h"
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// ========== State ==========
+// Everything here runs on core0: commands arrive in lwIP callbacks and the
+// finished jobs are collected by the service pass.
+
+#define CMD_ID_MAX 33 // Correlation id, 32 chars
+
+typedef struct {
+    uint32_t job;           // 0 = free
+    job_type_t type;
+    char corr[CMD_ID_MAX];
+} pending_cmd_t;
+
+static char device_id[2 * PICO_UNIQUE_BOARD_ID_SIZE_BYTES + 1];
+static char cmd_topic[48];
+static char fleet_topic[48];
+static char resp_topic[48];
+static pending_cmd_t pending[JOB_SLOTS];
+
+// ========== Parsing ==========
+// Commands are small flat objects, so a key lookup is enough: no nesting,
+// no escapes (a value that needs them is rejected).
+
+// Point at the value of "key", or NULL
+static const char *find_value(const char *json, const char *key) {
+    size_t key_len = strlen(key);
+    for (const char *p = strchr(json, '"'); p; p = strchr(p + 1, '"')) {
+        if (strncmp(p + 1, key, key_len) != 0 || p[1 + key_len] != '"') continue;
+        const char *v = p + 2 + key_len;
+        while (isspace((unsigned char)*v)) v++;
+        if (*v++ != ':') continue;
+        while (isspace((unsigned char)*v)) v++;
+        return v;
+    }
+    return NULL;
+}
+
+static bool get_string(const char *json, const char *key, char *out, size_t cap) {
+    const char *v = find_value(json, key);
+    if (!v || *v != '"') return false;
+    size_t n = strcspn(v + 1, "\"\\");
+    if (v[1 + n] != '"' || n + 1 > cap) return false;
+    memcpy(out, v + 1, n);
+    out[n] = '\0';
+    return true;
+}
+
+// Plain number, or a string such as "0x1000"
+static bool get_uint(const char *json, const char *key, uint32_t *out) {
+    const char *v = find_value(json, key);
+    if (!v) return false;
+    if (*v == '"') v++;
+    char *end;
+    unsigned long n = strtoul(v, &end, 0);
+    if (end == v) return false;
+    *out = (uint32_t)n;
+    return true;
+}
+
+// The id is echoed back inside JSON: keep it to characters that need no escaping
+static bool valid_corr(const char *s) {
+    for (; *s; s++) {
+        if (!isalnum((unsigned char)*s) && !strchr("-_.:", *s)) return false;
+    }
+    return true;
+}
+
+// ========== Responses ==========
+
+static void respond(const char *corr, const char *cmd, const char *status, const char *rest) {
+    char msg[MQTT_OUTBOX_PAYLOAD];
+    snprintf(msg, sizeof(msg), "{\"id\":\"%s\",\"device\":\"%s\",\"cmd\":\"%s\",\"status\":\"%s\"%s}",
+             corr, device_id, cmd, status, rest);
+    mqtt_enqueue(resp_topic, msg);
+}
+
+static void respond_status(const char *corr) {
+    char rest[MQTT_OUTBOX_PAYLOAD / 2];
+    char jedec[9] = "null";
+    if (last_jedec_id[0] != 0xFF) {
+        snprintf(jedec, sizeof(jedec), "\"%02X%02X%02X\"", last_jedec_id[0], last_jedec_id[1],
+                 last_jedec_id[2]);
+    }
+    snprintf(rest, sizeof(rest), ",\"ip\":\"%s\",\"sd\":%s,\"jedec\":%s,\"uptime_ms\":%lu",
+             pico_ip_address, sd_ready ? "true" : "false", jedec,
+             (unsigned long)to_ms_since_boot(get_absolute_time()));
+    respond(corr, "status", "ok", rest);
+}
+
+// ========== Public API ==========
+
+void mqtt_cmd_init(void) {
+    pico_get_unique_board_id_string(device_id, sizeof(device_id));
+    snprintf(cmd_topic, sizeof(cmd_topic), "%s/%s", MQTT_TOPIC_CMD, device_id);
+    snprintf(fleet_topic, sizeof(fleet_topic), "%s/all", MQTT_TOPIC_CMD);
+    snprintf(resp_topic, sizeof(resp_topic), "%s/%s", MQTT_TOPIC_RESP, device_id);
+    printf("MQTT commands: %s (fleet: %s)\n", cmd_topic, fleet_topic);
+}
+
+const char *mqtt_cmd_device_id(void) {
+    return device_id;
+}
+
+const char *mqtt_cmd_topic(bool fleet) {
+    return fleet ? fleet_topic : cmd_topic;
+}
+
+void mqtt_cmd_receive(const char *payload, size_t len) {
+    char corr[CMD_ID_MAX] = "";
+    char cmd[8] = "";
+    char file[13] = "";
+    uint32_t addr = 0, job_len = 0;
+
+    if (!get_string(payload, "id", corr, sizeof(corr)) || !valid_corr(corr)) {
+        printf("MQTT command without a usable id ignored\n");
+        return; // Nothing to correlate an answer with
+    }
+    if (!get_string(payload, "cmd", cmd, sizeof(cmd))) {
+        respond(corr, "", "error", ",\"error\":\"missing cmd\"");
+        return;
+    }
+    printf("MQTT command %s: %s\n", corr, cmd);
+
+    if (strcmp(cmd, "status") == 0) {
+        respond_status(corr);
+        return;
+    }
+
+    job_type_t type = job_type_from_name(cmd);
+    if (type != JOB_SCAN && type != JOB_HASH && type != JOB_DUMP) {
+        respond(corr, cmd, "error", ",\"error\":\"cmd must be scan, hash, dump or status\"");
+        return;
+    }
+    get_uint(payload, "addr", &addr);
+    get_uint(payload, "len", &job_len);
+    if (get_string(payload, "file", file, sizeof(file)) &&
+        (!valid_corr(file) || strstr(file, ".."))) {
+        respond(corr, cmd, "error", ",\"error\":\"bad file name\"");
+        return;
+    }
+    if (type == JOB_DUMP && !sd_ready) {
+        respond(corr, cmd, "error", ",\"error\":\"no SD card\"");
+        return;
+    }
+
+    pending_cmd_t *slot = NULL;
+    for (int i = 0; i < JOB_SLOTS && !slot; i++) {
+        if (pending[i].job == 0) slot = &pending[i];
+    }
+    uint32_t id = slot ? jobs_submit(type, addr, job_len, file) : 0;
+    if (id == 0) {
+        respond(corr, cmd, "error", ",\"error\":\"job queue full\"");
+        return;
+    }
+
+    slot->job = id;
+    slot->type = type;
+    strcpy(slot->corr, corr);
+    char rest[24];
+    snprintf(rest, sizeof(rest), ",\"job\":%lu", (unsigned long)id);
+    respond(corr, cmd, "accepted", rest);
+}
+
+void mqtt_cmd_service(void) {
+    for (int i = 0; i < JOB_SLOTS; i++) {
+        pending_cmd_t *p = &pending[i];
+        if (p->job == 0) continue;
+
+        job_t job;
+        if (!jobs_get(p->job, &job)) {
+            respond(p->corr, job_type_name(p->type), "failed", ",\"error\":\"job expired\"");
+            p->job = 0;
+            continue;
+        }
+        if (job.state != JOB_DONE && job.state != JOB_FAILED) continue;
+
+        char rest[MQTT_OUTBOX_PAYLOAD - 96];
+        uint32_t elapsed = job.finished_ms - job.started_ms;
+        if (job.state == JOB_DONE) {
+            snprintf(rest, sizeof(rest), ",\"job\":%lu,\"ms\":%lu,\"result\":%s",
+                     (unsigned long)job.id, (unsigned long)elapsed,
+                     job.result[0] ? job.result : "{}");
+        } else {
+            snprintf(rest, sizeof(rest), ",\"job\":%lu,\"ms\":%lu,\"error\":\"%s\"",
+                     (unsigned long)job.id, (unsigned long)elapsed, job.result);
+        }
+        respond(p->corr, job_type_name(p->type), job.state == JOB_DONE ? "done" : "failed",
+                rest);
+        p->job = 0;
+    }
+}
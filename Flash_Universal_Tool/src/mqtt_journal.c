@@ -0,0 +1,193 @@
+#include "mqtt_journal.h"
+#include "config.h"
+#include "sd_card.h"
+#include <stdio.h>
+#include <string.h>
+
+// ========== Format ==========
+// Records back to back: header, topic (no NUL), payload. A record that
+// runs past the end of the file was cut short by a reset and ends the
+// journal; nothing is appended after it until the file is emptied.
+
+#define JOURNAL_MAGIC 0x314A514Du // "MQJ1"
+
+typedef struct {
+    uint32_t magic;
+    uint32_t len;      // Payload bytes
+    uint8_t topic_len;
+    uint8_t reserved[3];
+} journal_header_t;
+
+static bool ready = false;
+static bool torn = false;     // Garbage past `size`
+static uint32_t size = 0;     // End of the last complete record
+static uint32_t cursor = 0;   // First record not yet delivered
+static uint32_t messages = 0; // Records from cursor to size
+static uint32_t drops = 0;
+static uint8_t copy_buf[1024];
+
+static bool read_header(uint32_t at, uint32_t limit, journal_record_t *rec) {
+    journal_header_t h;
+    if (at + sizeof(h) > limit ||
+        journal_read_payload(at, (uint8_t *)&h, sizeof(h)) != (int)sizeof(h) ||
+        h.magic != JOURNAL_MAGIC || h.topic_len >= sizeof(rec->topic)) {
+        return false;
+    }
+    rec->offset = at + sizeof(h) + h.topic_len;
+    rec->len = h.len;
+    rec->next = rec->offset + h.len;
+    if (rec->next > limit || rec->next < rec->offset ||
+        journal_read_payload(at + sizeof(h), (uint8_t *)rec->topic, h.topic_len) !=
+            h.topic_len) {
+        return false;
+    }
+    rec->topic[h.topic_len] = '\0';
+    return true;
+}
+
+static void save_cursor(void) {
+    sd_write_binary_safe(MQTT_JOURNAL_POS, (const uint8_t *)&cursor, sizeof(cursor), false);
+}
+
+// Everything delivered: start over with an empty file. That also cuts off
+// a torn tail, which would otherwise refuse every append from now on.
+static bool empty_if_delivered(void) {
+    if (cursor < size || !sd_write_binary_safe(MQTT_JOURNAL_FILE, copy_buf, 0, false)) {
+        return false;
+    }
+    size = cursor = messages = 0;
+    torn = false;
+    return true;
+}
+
+// An append failed part way. With nothing pending there is nothing to
+// replay ahead of the garbage, so drop it now rather than at a commit
+// that will never come.
+static void append_failed(void) {
+    torn = true;
+    drops++;
+    if (empty_if_delivered()) save_cursor();
+}
+
+// Header + topic for a payload of len bytes; false (and counted) if it won't fit
+static bool append_header(const char *topic, uint32_t len) {
+    size_t topic_len = strlen(topic);
+    journal_header_t h = {JOURNAL_MAGIC, len, (uint8_t)topic_len, {0}};
+
+    if (!ready || torn || topic_len >= sizeof(((journal_record_t *)0)->topic) ||
+        size + sizeof(h) + topic_len + len > MQTT_JOURNAL_MAX) {
+        drops++;
+        return false;
+    }
+    memcpy(copy_buf, &h, sizeof(h));
+    memcpy(copy_buf + sizeof(h), topic, topic_len);
+    if (!sd_write_binary_safe(MQTT_JOURNAL_FILE, copy_buf, sizeof(h) + topic_len, true)) {
+        append_failed(); // May have written part of it
+        return false;
+    }
+    return true;
+}
+
+static void append_done(const char *topic, uint32_t len) {
+    size += sizeof(journal_header_t) + strlen(topic) + len;
+    messages++;
+}
+
+// ========== Public API ==========
+
+void journal_init(void) {
+    if (!sd_is_mounted()) return;
+
+    int32_t file_size = sd_file_size_safe(MQTT_JOURNAL_FILE);
+    uint32_t limit = (file_size > 0) ? (uint32_t)file_size : 0;
+    uint32_t saved = 0;
+    if (sd_read_binary_safe(MQTT_JOURNAL_POS, 0, (uint8_t *)&saved, sizeof(saved)) !=
+        sizeof(saved)) {
+        saved = 0;
+    }
+
+    // Walk the headers to find the end, and check the saved position is a
+    // record boundary (otherwise replay everything)
+    journal_record_t rec;
+    uint32_t at = 0, total = 0, after_saved = 0;
+    bool saved_ok = (saved == 0);
+    while (read_header(at, limit, &rec)) {
+        if (at >= saved) after_saved++;
+        total++;
+        at = rec.next;
+        if (at == saved) saved_ok = true;
+    }
+
+    size = at;
+    torn = (at < limit);
+    cursor = saved_ok ? saved : 0;
+    messages = saved_ok ? after_saved : total;
+    ready = true;
+    if (torn && empty_if_delivered()) {
+        save_cursor();
+        printf("MQTT journal: incomplete record discarded\n");
+    }
+
+    if (messages > 0 || torn) {
+        printf("MQTT journal: %lu message(s) to replay%s\n", (unsigned long)messages,
+               torn ? ", incomplete record at the end" : "");
+    }
+}
+
+bool journal_append(const char *topic, const void *data, size_t len) {
+    if (!append_header(topic, len)) return false;
+    if (len > 0 && !sd_write_binary_safe(MQTT_JOURNAL_FILE, data, len, true)) {
+        append_failed();
+        return false;
+    }
+    append_done(topic, len);
+    return true;
+}
+
+bool journal_append_file(const char *topic, const char *file) {
+    int32_t len = sd_file_size_safe(file);
+    if (len <= 0 || !append_header(topic, (uint32_t)len)) return false;
+
+    for (uint32_t off = 0; off < (uint32_t)len;) {
+        uint32_t n = (uint32_t)len - off;
+        if (n > sizeof(copy_buf)) n = sizeof(copy_buf);
+        if (sd_read_binary_safe(file, off, copy_buf, n) != (int)n ||
+            !sd_write_binary_safe(MQTT_JOURNAL_FILE, copy_buf, n, true)) {
+            append_failed();
+            return false;
+        }
+        off += n;
+    }
+    append_done(topic, (uint32_t)len);
+    return true;
+}
+
+bool journal_read(uint32_t at, journal_record_t *rec) {
+    return ready && read_header(at, size, rec);
+}
+
+int journal_read_payload(uint32_t offset, uint8_t *buf, size_t len) {
+    return sd_read_binary_safe(MQTT_JOURNAL_FILE, offset, buf, len);
+}
+
+uint32_t journal_cursor(void) {
+    return cursor;
+}
+
+bool journal_pending(void) {
+    return ready && cursor < size;
+}
+
+void journal_commit(uint32_t new_cursor, uint32_t records) {
+    cursor = new_cursor;
+    messages = (records < messages) ? messages - records : 0;
+
+    empty_if_delivered();
+    save_cursor();
+}
+
+void journal_stats(uint32_t *out_messages, uint32_t *bytes, uint32_t *out_drops) {
+    *out_messages = messages;
+    *bytes = size - cursor;
+    *out_drops = drops;
+}
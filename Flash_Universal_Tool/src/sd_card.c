@@ -5,6 +5,7 @@
 #include "sd_card.h"
 #include "diskio.h"
 #include "ff.h"
+#include "metrics.h"
 #include "pico/stdlib.h"
 #include "pico/mutex.h"
 #include <stdio.h>
@@ -12,7 +13,7 @@
 
 static FATFS fatfs;
 static bool sd_mounted = false;
-static mutex_t sd_mutex;
+static recursive_mutex_t sd_mutex; // Recursive: see sd_try_lock
 
 // Helper function to create directory if it doesn't exist
 static bool ensure_directory_exists(const char *path) {
@@ -32,7 +33,7 @@ static bool ensure_directory_exists(const char *path) {
 // Wrapper to Init Hardware, Mount, and Mutex
 bool sd_full_init(void) {
     printf("\n========== SD CARD INITIALIZATION ==========\n");
-    mutex_init(&sd_mutex);
+    recursive_mutex_init(&sd_mutex);
 
     // Hardware Initialization
     if (!sd_card_init()) {
@@ -188,9 +189,9 @@ int sd_read_file(const char *filename, char *buffer, size_t buffer_size) {
 bool sd_write_safe(const char *filename, const char *data) {
     if (!sd_mounted) return false;
 
-    mutex_enter_blocking(&sd_mutex);
+    metrics_lock(&sd_mutex, METRICS_LOCK_SD);
     bool success = sd_write_file(filename, data);
-    mutex_exit(&sd_mutex);
+    metrics_unlock(&sd_mutex, METRICS_LOCK_SD);
 
     if (!success) {
         printf("✗ Write failed: %s\n", filename);
@@ -208,20 +209,189 @@ bool sd_read_safe(const char *filename, char *buffer, size_t buffer_size) {
         return false;
     }
 
-    mutex_enter_blocking(&sd_mutex);
+    metrics_lock(&sd_mutex, METRICS_LOCK_SD);
 
     if (!sd_file_exists(filename)) {
-        mutex_exit(&sd_mutex);
+        metrics_unlock(&sd_mutex, METRICS_LOCK_SD);
         snprintf(buffer, buffer_size, "{\"error\":\"File not found\"}");
         return false;
     }
 
     int bytes_read = sd_read_file(filename, buffer, buffer_size);
-    mutex_exit(&sd_mutex);
+    metrics_unlock(&sd_mutex, METRICS_LOCK_SD);
 
     if (bytes_read < 0) {
         snprintf(buffer, buffer_size, "{\"error\":\"Read failed\"}");
         return false;
     }
     return true;
-}
\ No newline at end of file
+}
+
+bool sd_write_binary_safe(const char *filename, const uint8_t *data, size_t len,
+                          bool append) {
+    if (!sd_mounted) return false;
+
+    metrics_lock(&sd_mutex, METRICS_LOCK_SD);
+
+    FIL file;
+    FRESULT fr = f_open(&file, filename,
+                        FA_WRITE | (append ? FA_OPEN_ALWAYS : FA_CREATE_ALWAYS));
+    if (fr != FR_OK) {
+        metrics_unlock(&sd_mutex, METRICS_LOCK_SD);
+        printf("### Failed to open %s for writing (error: %d)\n", filename, fr);
+        return false;
+    }
+
+    if (append) {
+        f_lseek(&file, f_size(&file));
+    }
+
+    UINT bytes_written = 0;
+    fr = f_write(&file, data, (UINT)len, &bytes_written);
+    f_close(&file);
+    metrics_unlock(&sd_mutex, METRICS_LOCK_SD);
+
+    if (fr != FR_OK || bytes_written != len) {
+        printf("✗ Write failed: %s (error: %d)\n", filename, fr);
+        return false;
+    }
+    return true;
+}
+
+int sd_read_binary_safe(const char *filename, uint32_t offset, uint8_t *buffer,
+                        size_t len) {
+    if (!sd_mounted) return -1;
+
+    metrics_lock(&sd_mutex, METRICS_LOCK_SD);
+
+    FIL file;
+    FRESULT fr = f_open(&file, filename, FA_OPEN_EXISTING | FA_READ);
+    if (fr != FR_OK) {
+        metrics_unlock(&sd_mutex, METRICS_LOCK_SD);
+        return -1;
+    }
+
+    UINT bytes_read = 0;
+    fr = f_lseek(&file, offset);
+    if (fr == FR_OK) {
+        fr = f_read(&file, buffer, (UINT)len, &bytes_read);
+    }
+    f_close(&file);
+    metrics_unlock(&sd_mutex, METRICS_LOCK_SD);
+
+    return (fr == FR_OK) ? (int)bytes_read : -1;
+}
+
+int32_t sd_file_size_safe(const char *filename) {
+    if (!sd_mounted) return -1;
+
+    metrics_lock(&sd_mutex, METRICS_LOCK_SD);
+    FILINFO fno;
+    FRESULT fr = f_stat(filename, &fno);
+    metrics_unlock(&sd_mutex, METRICS_LOCK_SD);
+
+    return (fr == FR_OK) ? (int32_t)fno.fsize : -1;
+}
+
+// ========== STREAMING SINK ==========
+
+static struct {
+    stream_sink_t base;
+    FIL file;
+    bool failed;
+} sd_stream;
+
+static bool sd_sink_write(stream_sink_t *sink, const void *data, size_t len) {
+    UINT bytes_written = 0;
+    FRESULT fr = f_write(&sd_stream.file, data, (UINT)len, &bytes_written);
+    if (fr != FR_OK || bytes_written != len) {
+        sd_stream.failed = true;
+        return false;
+    }
+    return true;
+}
+
+stream_sink_t *sd_sink_open(const char *filename) {
+    if (!sd_mounted) return NULL;
+
+    metrics_lock(&sd_mutex, METRICS_LOCK_SD);
+    FRESULT fr = f_open(&sd_stream.file, filename, FA_CREATE_ALWAYS | FA_WRITE);
+    if (fr != FR_OK) {
+        metrics_unlock(&sd_mutex, METRICS_LOCK_SD);
+        printf("### Failed to open %s for streaming (error: %d)\n", filename, fr);
+        return NULL;
+    }
+
+    sd_stream.base.write = sd_sink_write;
+    sd_stream.base.ctx = &sd_stream.file;
+    sd_stream.base.written = 0;
+    sd_stream.failed = false;
+    return &sd_stream.base;
+}
+
+bool sd_sink_close(stream_sink_t *sink) {
+    if (sink != &sd_stream.base) return false;
+
+    FRESULT fr = f_close(&sd_stream.file);
+    bool ok = !sd_stream.failed && fr == FR_OK;
+    metrics_unlock(&sd_mutex, METRICS_LOCK_SD);
+
+    if (ok) {
+        printf("✓ Streamed to SD (%u bytes)\n", (unsigned int)sink->written);
+    }
+    return ok;
+}
+
+// ========== HELD-OPEN WRITER ==========
+// Unlike the sink, the lock is taken per write, so a long dump doesn't
+// keep everyone else off the card for its whole length.
+
+static struct {
+    FIL file;
+    bool open;
+} sd_writer;
+
+bool sd_writer_open(const char *filename) {
+    if (!sd_mounted || sd_writer.open) return false;
+
+    metrics_lock(&sd_mutex, METRICS_LOCK_SD);
+    FRESULT fr = f_open(&sd_writer.file, filename, FA_CREATE_ALWAYS | FA_WRITE);
+    metrics_unlock(&sd_mutex, METRICS_LOCK_SD);
+
+    if (fr != FR_OK) {
+        printf("### Failed to open %s for writing (error: %d)\n", filename, fr);
+        return false;
+    }
+    sd_writer.open = true;
+    return true;
+}
+
+bool sd_writer_write(const uint8_t *data, size_t len) {
+    if (!sd_writer.open) return false;
+
+    metrics_lock(&sd_mutex, METRICS_LOCK_SD);
+    UINT bytes_written = 0;
+    FRESULT fr = f_write(&sd_writer.file, data, (UINT)len, &bytes_written);
+    metrics_unlock(&sd_mutex, METRICS_LOCK_SD);
+
+    return fr == FR_OK && bytes_written == len;
+}
+
+bool sd_writer_close(void) {
+    if (!sd_writer.open) return false;
+
+    metrics_lock(&sd_mutex, METRICS_LOCK_SD);
+    FRESULT fr = f_close(&sd_writer.file);
+    metrics_unlock(&sd_mutex, METRICS_LOCK_SD);
+
+    sd_writer.open = false;
+    return fr == FR_OK;
+}
+
+bool sd_try_lock(void) {
+    return metrics_try_lock(&sd_mutex, METRICS_LOCK_SD);
+}
+
+void sd_unlock(void) {
+    metrics_unlock(&sd_mutex, METRICS_LOCK_SD);
+}
@@ -3,59 +3,219 @@
 #include "spi_ops.h"
 #include "flash_info.h"
 #include "json.h"
+#include "cbor.h"
+#include "sd_card.h"
+#include "metrics.h"
+#include "flash_cache.h"
 #include "hardware/gpio.h"
+#include "pico/stdlib.h"
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
+
+// ========== Cached Diagnostic Result ==========
+// The safe sweep is deterministic for a given chip state, so the last raw
+// report is kept and only re-run when the fingerprint (JEDEC ID + status
+// registers) changes or the cache ages out.
+
+typedef struct {
+    bool valid;
+    uint8_t report[DIAG_REPORT_MAX];
+    size_t report_len;
+    uint32_t etag;
+    uint32_t timestamp;
+} diag_cache_t;
+
+static diag_cache_t diag_cache;
+static const char *diag_error = "Not scanned";
+
+// FNV-1a over the raw report; JSON is rendered from it deterministically
+static uint32_t diag_hash(const uint8_t *buf, size_t len) {
+    uint32_t h = 2166136261u;
+    for (size_t i = 0; i < len; i++) {
+        h ^= buf[i];
+        h *= 16777619u;
+    }
+    return h;
+}
 
-// Run full SPI diagnostic and generate JSON report
-bool run_spi_diagnostic(char *json_out, size_t json_cap) {
-    if (!spi_initialized) {
-        snprintf(json_out, json_cap, "{\"error\":\"SPI not initialized\"}");
+// Remember the JEDEC ID; a different one means the chip was swapped and
+// sectors cached from the old one are worthless
+static void note_jedec_id(const uint8_t *id) {
+    if (memcmp(id, last_jedec_id, 3) != 0) {
+        flash_cache_invalidate_all();
+        memcpy(last_jedec_id, id, 3);
+    }
+}
+
+// Read JEDEC ID + SR1..SR3 (safeOps entries 0-3). Caller holds spi_mutex.
+static bool read_fingerprint_locked(uint8_t *fp) {
+    size_t offset = 0;
+    for (size_t i = 0; offset < DIAG_FINGERPRINT_LEN; i++) {
+        const opcode *cmd = get_command_by_index(i);
+        if (!cmd || cmd->tx_len != 1 ||
+            offset + cmd->rx_data_len > DIAG_FINGERPRINT_LEN) {
+            return false;
+        }
+        uint8_t tx_buffer[1];
+        spi_ONE_transfer(SPI_PORT, *cmd, tx_buffer, &fp[offset]);
+        offset += cmd->rx_data_len;
+    }
+    return true;
+}
+
+bool spi_diag_try_read_fingerprint(uint8_t *fp) {
+    if (!spi_initialized || !metrics_try_lock(&spi_mutex, METRICS_LOCK_SPI)) {
         return false;
     }
+    bool ok = read_fingerprint_locked(fp);
+    metrics_unlock(&spi_mutex, METRICS_LOCK_SPI);
+    return ok;
+}
 
-    mutex_enter_blocking(&spi_mutex);
+diag_status_t spi_diag_refresh(void) {
+    if (!spi_initialized) {
+        diag_error = "SPI not initialized";
+        return DIAG_ERROR;
+    }
 
-    // Get expected report size
     size_t expected = get_expected_report_size();
     if (expected == 0) {
-        mutex_exit(&spi_mutex);
-        snprintf(json_out, json_cap, "{\"error\":\"No commands defined\"}");
-        return false;
+        diag_error = "No commands defined";
+        return DIAG_ERROR;
+    }
+    if (expected > DIAG_REPORT_MAX) {
+        diag_error = "Report larger than cache";
+        return DIAG_ERROR;
     }
 
-    // Allocate buffer for raw SPI data
-    uint8_t *report = malloc(expected);
-    if (!report) {
-        mutex_exit(&spi_mutex);
-        snprintf(json_out, json_cap, "{\"error\":\"Memory allocation failed\"}");
-        return false;
+    metrics_lock(&spi_mutex, METRICS_LOCK_SPI);
+
+    uint32_t now = to_ms_since_boot(get_absolute_time());
+    uint8_t fp[DIAG_FINGERPRINT_LEN];
+
+    if (diag_cache.valid && now - diag_cache.timestamp < DIAG_CACHE_MAX_AGE_MS &&
+        read_fingerprint_locked(fp) &&
+        memcmp(fp, diag_cache.report, DIAG_FINGERPRINT_LEN) == 0) {
+        metrics_unlock(&spi_mutex, METRICS_LOCK_SPI);
+        return DIAG_CACHED;
     }
 
     // Execute safe operation transfer
-    int stored = spi_OPSAFE_transfer(SPI_PORT, report, expected);
+    int stored = spi_OPSAFE_transfer(SPI_PORT, diag_cache.report, DIAG_REPORT_MAX);
 
     if (stored <= 0) {
-        free(report);
-        mutex_exit(&spi_mutex);
-        snprintf(json_out, json_cap, "{\"error\":\"SPI transfer failed\"}");
-        return false;
+        diag_cache.valid = false;
+        metrics_unlock(&spi_mutex, METRICS_LOCK_SPI);
+        diag_error = "SPI transfer failed";
+        return DIAG_ERROR;
     }
 
     // Store JEDEC ID for quick reference
     if (stored >= 3) {
-        last_jedec_id[0] = report[0];
-        last_jedec_id[1] = report[1];
-        last_jedec_id[2] = report[2];
+        note_jedec_id(diag_cache.report);
+    }
+
+    uint32_t old_etag = diag_cache.valid ? diag_cache.etag : 0;
+    diag_cache.report_len = (size_t)stored;
+    diag_cache.etag = diag_hash(diag_cache.report, diag_cache.report_len);
+    diag_cache.timestamp = now;
+    diag_cache.valid = true;
+
+    metrics_unlock(&spi_mutex, METRICS_LOCK_SPI);
+
+    // An aged-out sweep that came back identical doesn't count as a change
+    return (diag_cache.etag == old_etag) ? DIAG_CACHED : DIAG_UPDATED;
+}
+
+// Copy the cached report out under the lock so a refresh on the other core
+// can't tear it. Returns 0 if there is no valid sweep.
+size_t spi_diag_snapshot(uint8_t *report) {
+    size_t report_len = 0;
+    metrics_lock(&spi_mutex, METRICS_LOCK_SPI);
+    if (diag_cache.valid) {
+        report_len = diag_cache.report_len;
+        memcpy(report, diag_cache.report, report_len);
+    }
+    metrics_unlock(&spi_mutex, METRICS_LOCK_SPI);
+    return report_len;
+}
+
+size_t spi_diag_render_json(char *json_out, size_t json_cap) {
+    uint8_t report[DIAG_REPORT_MAX];
+    size_t report_len = spi_diag_snapshot(report);
+
+    if (report_len == 0) {
+        snprintf(json_out, json_cap, "{\"error\":\"%s\"}", diag_error);
+        return 0;
     }
 
-    // Generate JSON from raw data
-    size_t written = json_export_full_report(json_out, json_cap, report, stored);
+    return json_export_full_report(json_out, json_cap, report, report_len);
+}
+
+bool spi_diag_stream_json(stream_sink_t *sink) {
+    uint8_t report[DIAG_REPORT_MAX];
+    size_t report_len = spi_diag_snapshot(report);
 
-    free(report);
-    mutex_exit(&spi_mutex);
+    if (report_len == 0) {
+        char err[64];
+        int n = snprintf(err, sizeof(err), "{\"error\":\"%s\"}", diag_error);
+        stream_sink_write(sink, err, (size_t)n);
+        return false;
+    }
 
-    return (written > 0);
+    return json_stream_full_report(sink, report, report_len);
+}
+
+bool spi_diag_stream_cbor(stream_sink_t *sink) {
+    uint8_t report[DIAG_REPORT_MAX];
+    size_t report_len = spi_diag_snapshot(report);
+
+    if (report_len == 0) {
+        cbor_stream_error(sink, diag_error);
+        return false;
+    }
+
+    return cbor_stream_full_report(sink, report, report_len);
+}
+
+bool spi_diag_save_reports(void) {
+    if (!sd_ready) {
+        return false;
+    }
+
+    // One sink at a time: sd_sink_open holds the SD lock until closed
+    stream_sink_t *sd = sd_sink_open(REPORT_FILE_JSON);
+    bool ok = sd && spi_diag_stream_json(sd);
+    if (sd) ok = sd_sink_close(sd) && ok;
+
+    sd = sd_sink_open(REPORT_FILE_CBOR);
+    bool cbor_ok = sd && spi_diag_stream_cbor(sd);
+    if (sd) cbor_ok = sd_sink_close(sd) && cbor_ok;
+
+    return ok && cbor_ok;
+}
+
+uint32_t spi_diag_etag(void) {
+    return diag_cache.valid ? diag_cache.etag : 0;
+}
+
+// Under the lock, so it can't land in the middle of a refresh and be
+// overwritten when that marks the cache valid again
+void spi_diag_invalidate(void) {
+    if (!spi_initialized) return; // Nothing cached yet
+    metrics_lock(&spi_mutex, METRICS_LOCK_SPI);
+    diag_cache.valid = false;
+    metrics_unlock(&spi_mutex, METRICS_LOCK_SPI);
+}
+
+// Run full SPI diagnostic and generate JSON report
+bool run_spi_diagnostic(char *json_out, size_t json_cap) {
+    if (spi_diag_refresh() == DIAG_ERROR) {
+        snprintf(json_out, json_cap, "{\"error\":\"%s\"}", diag_error);
+        return false;
+    }
+    return (spi_diag_render_json(json_out, json_cap) > 0);
 }
 
 // Quick JEDEC ID read
@@ -64,11 +224,11 @@ bool read_jedec_id(uint8_t *mfr, uint8_t *mem_type, uint8_t *capacity) {
         return false;
     }
 
-    mutex_enter_blocking(&spi_mutex);
+    metrics_lock(&spi_mutex, METRICS_LOCK_SPI);
 
     const opcode *jedec_cmd = get_command_by_index(0); // JEDEC is first command
     if (!jedec_cmd) {
-        mutex_exit(&spi_mutex);
+        metrics_unlock(&spi_mutex, METRICS_LOCK_SPI);
         return false;
     }
 
@@ -78,19 +238,17 @@ bool read_jedec_id(uint8_t *mfr, uint8_t *mem_type, uint8_t *capacity) {
     int result = spi_ONE_transfer(SPI_PORT, *jedec_cmd, tx_buffer, rx_buffer);
     gpio_put(CS_PIN, 1);
 
-    mutex_exit(&spi_mutex);
+    metrics_unlock(&spi_mutex, METRICS_LOCK_SPI);
 
     if (result == 3) {
         *mfr = rx_buffer[0];
         *mem_type = rx_buffer[1];
         *capacity = rx_buffer[2];
 
-        last_jedec_id[0] = rx_buffer[0];
-        last_jedec_id[1] = rx_buffer[1];
-        last_jedec_id[2] = rx_buffer[2];
+        note_jedec_id(rx_buffer);
 
         return true;
     }
 
     return false;
-}
\ No newline at end of file
+}
@@ -1,6 +1,7 @@
 #include "spi_ops.h"
 #include "flash_db.h"
 #include "flash_info.h"
+#include "metrics.h"
 #include "hardware/gpio.h"
 #include "hardware/spi.h"
 #include "pico/stdlib.h"
@@ -229,6 +230,8 @@ int spi_transfer_block(spi_inst_t *spi, const uint8_t *tx_buffer,
                                                   len); // Full duplex transmit
   gpio_put(CS_PIN, 1);                                  // Comms down
   sleep_us(10);                                         // Recovery time
+  if (len > 0)
+    metrics_spi(tx_buffer[0], len);
   return bytes_transferred;
 }
 
@@ -247,6 +250,7 @@ int spi_ONE_transfer(spi_inst_t *spi, opcode Opcode, uint8_t *tx_buffer,
   spi_read_blocking(spi, 0x00, rx_buffer, Opcode.rx_data_len);
   sleep_us(1);
   gpio_put(CS_PIN, 1);
+  metrics_spi(Opcode.opcode, Opcode.tx_len + Opcode.rx_data_len);
 
   return Opcode.rx_data_len;
 }
@@ -295,6 +299,7 @@ int spi_OPSAFE_transfer(spi_inst_t *spi, uint8_t *master_rx_buffer,
 
     sleep_us(1);
     gpio_put(CS_PIN, 1);
+    metrics_spi(cmd->opcode, cmd->tx_len + cmd->rx_data_len);
 
     // --- Store directly (no junk math) ---
     memcpy(&master_rx_buffer[offset], rx, cmd->rx_data_len);
@@ -355,6 +360,7 @@ void spi_fuzz_scan(spi_inst_t *spi) {
     sleep_us(1);
     gpio_put(CS_PIN, 1);
     sleep_us(50);
+    metrics_spi(op, 1 + sizeof(rx_buffer));
 
     // 4. Analyze: Is the data interesting?
     bool interesting = false;
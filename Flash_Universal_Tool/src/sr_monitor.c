@@ -0,0 +1,103 @@
+#include "sr_monitor.h"
+#include "spi_diag.h"
+#include "mqtt.h"
+#include "events.h"
+#include "config.h"
+#include "pico/stdlib.h"
+#include <stdio.h>
+#include <string.h>
+
+// ========== Status Register Watch ==========
+// The first change after a quiet period is published immediately; further
+// changes inside SR_MONITOR_COALESCE_MS are folded into one trailing message
+// carrying the final state and the number of transitions seen.
+
+#define SR1_BUSY 0x01
+#define SR1_WEL 0x02
+#define SR1_BP_MASK 0x1C
+
+static uint32_t interval_ms = SR_MONITOR_INTERVAL_MS;
+static uint32_t next_sample_ms = 0;
+
+static bool have_baseline = false;
+static uint8_t current[DIAG_FINGERPRINT_LEN];   // Latest sample
+static uint8_t published[DIAG_FINGERPRINT_LEN]; // Last state sent to MQTT
+static uint32_t transitions = 0;                // Changes since last publish
+static uint32_t last_publish_ms = 0;
+static bool pending = false;
+
+void sr_monitor_set_interval(uint32_t ms) {
+    interval_ms = ms;
+    have_baseline = false; // Re-announce the state when re-enabled
+}
+
+uint32_t sr_monitor_get_interval(void) {
+    return interval_ms;
+}
+
+static void publish_state(uint32_t now) {
+    char changed[24] = "";
+    static const char *const fields[] = {"jedec", "sr1", "sr2", "sr3"};
+    bool diff[4] = {
+        memcmp(current, published, 3) != 0,
+        current[3] != published[3],
+        current[4] != published[4],
+        current[5] != published[5],
+    };
+    for (int i = 0; i < 4; i++) {
+        if (diff[i] || !have_baseline) {
+            if (changed[0]) strcat(changed, ",");
+            strcat(changed, fields[i]);
+        }
+    }
+
+    char msg[160];
+    snprintf(msg, sizeof(msg),
+             "{\"jedec\":\"%02X%02X%02X\",\"sr\":[\"%02X\",\"%02X\",\"%02X\"],"
+             "\"changed\":\"%s\",\"busy\":%d,\"wel\":%d,\"bp\":%d,"
+             "\"transitions\":%lu,\"t_ms\":%lu}",
+             current[0], current[1], current[2], current[3], current[4], current[5],
+             changed, (current[3] & SR1_BUSY) ? 1 : 0, (current[3] & SR1_WEL) ? 1 : 0,
+             (current[3] & SR1_BP_MASK) >> 2, (unsigned long)transitions,
+             (unsigned long)now);
+
+    mqtt_enqueue(MQTT_TOPIC_STATUS, msg);
+    events_publish("sr", msg);
+
+    memcpy(published, current, sizeof(published));
+    have_baseline = true;
+    transitions = 0;
+    last_publish_ms = now;
+    pending = false;
+}
+
+void sr_monitor_poll(void) {
+    if (interval_ms == 0) return;
+
+    uint32_t now = to_ms_since_boot(get_absolute_time());
+    if ((int32_t)(now - next_sample_ms) < 0) return;
+    next_sample_ms = now + interval_ms;
+
+    uint8_t sample[DIAG_FINGERPRINT_LEN];
+    if (!spi_diag_try_read_fingerprint(sample)) {
+        return; // Bus busy with real work, try again next period
+    }
+
+    if (!have_baseline) {
+        memcpy(current, sample, sizeof(current));
+        publish_state(now);
+        return;
+    }
+
+    if (memcmp(sample, current, sizeof(current)) != 0) {
+        memcpy(current, sample, sizeof(current));
+        transitions++;
+        pending = true;
+    }
+
+    // A burst that settled back to the published state (e.g. a BUSY pulse)
+    // is still reported, with an empty "changed" and its transition count
+    if (pending && now - last_publish_ms >= SR_MONITOR_COALESCE_MS) {
+        publish_state(now);
+    }
+}
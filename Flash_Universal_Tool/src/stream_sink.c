@@ -0,0 +1,67 @@
+#include "stream_sink.h"
+#include <stdio.h>
+#include <string.h>
+
+// ========== Memory Sink ==========
+
+static bool mem_sink_write(stream_sink_t *sink, const void *data, size_t len) {
+    mem_sink_t *m = (mem_sink_t *)sink;
+    if (sink->written + len >= m->cap) {
+        return false; // Keep room for the terminator
+    }
+    memcpy(m->buf + sink->written, data, len);
+    m->buf[sink->written + len] = '\0';
+    return true;
+}
+
+void mem_sink_init(mem_sink_t *m, char *buf, size_t cap) {
+    m->base.write = mem_sink_write;
+    m->base.ctx = m;
+    m->base.written = 0;
+    m->buf = buf;
+    m->cap = cap;
+    if (cap > 0) buf[0] = '\0';
+}
+
+// ========== Window Sink ==========
+
+static bool window_sink_write(stream_sink_t *sink, const void *data, size_t len) {
+    window_sink_t *w = (window_sink_t *)sink;
+    size_t pos = sink->written; // Stream offset of data[0]
+
+    if (pos + len <= w->skip) {
+        return true; // Entirely before the window
+    }
+
+    size_t from = (pos < w->skip) ? w->skip - pos : 0;
+    size_t take = len - from;
+    size_t room = w->cap - w->used;
+    bool fits = (take <= room);
+
+    if (!fits) take = room;
+    memcpy(w->buf + w->used, (const uint8_t *)data + from, take);
+    w->used += take;
+    return fits; // Window full: stop the producer
+}
+
+void window_sink_init(window_sink_t *w, size_t skip, uint8_t *buf, size_t cap) {
+    w->base.write = window_sink_write;
+    w->base.ctx = w;
+    w->base.written = 0;
+    w->skip = skip;
+    w->buf = buf;
+    w->cap = cap;
+    w->used = 0;
+}
+
+// ========== stdio (USB CDC) Sink ==========
+
+static bool stdio_sink_write(stream_sink_t *sink, const void *data, size_t len) {
+    return fwrite(data, 1, len, stdout) == len;
+}
+
+void stdio_sink_init(stream_sink_t *sink) {
+    sink->write = stdio_sink_write;
+    sink->ctx = NULL;
+    sink->written = 0;
+}
@@ -0,0 +1,82 @@
+#include "upload.h"
+#include "config.h"
+#include "pico/critical_section.h"
+#include <string.h>
+
+// ========== Upload Ring ==========
+// head/tail are running byte counts (index = count % size). core0 only
+// moves head, core1 only moves tail, and the data copies happen outside
+// the lock on regions the other side can't touch.
+
+static uint8_t ring[UPLOAD_RING_SIZE];
+static volatile uint32_t head, tail;
+static volatile bool open_flag = false;
+static volatile bool cancelled = false;
+static critical_section_t upload_lock;
+static bool upload_lock_ready = false;
+
+static uint32_t used_bytes(void) {
+    critical_section_enter_blocking(&upload_lock);
+    uint32_t n = head - tail;
+    critical_section_exit(&upload_lock);
+    return n;
+}
+
+void upload_init(void) {
+    critical_section_init(&upload_lock);
+    upload_lock_ready = true;
+}
+
+bool upload_open(uint32_t len) {
+    if (!upload_lock_ready || open_flag || len == 0) return false;
+
+    head = tail = 0;
+    cancelled = false;
+    open_flag = true;
+    return true;
+}
+
+size_t upload_write(const void *data, size_t len) {
+    if (!open_flag || cancelled) return 0;
+
+    uint32_t room = UPLOAD_RING_SIZE - used_bytes();
+    if (len > room) len = room;
+
+    // Copy in up to two pieces around the wrap
+    uint32_t at = head % UPLOAD_RING_SIZE;
+    size_t first = (len < UPLOAD_RING_SIZE - at) ? len : UPLOAD_RING_SIZE - at;
+    memcpy(ring + at, data, first);
+    memcpy(ring, (const uint8_t *)data + first, len - first);
+
+    critical_section_enter_blocking(&upload_lock);
+    head += len;
+    critical_section_exit(&upload_lock);
+    return len;
+}
+
+void upload_cancel(void) {
+    cancelled = true;
+}
+
+void upload_close(void) {
+    open_flag = false;
+}
+
+bool upload_active(void) {
+    return open_flag && !cancelled;
+}
+
+int upload_read(uint8_t *buf, size_t n) {
+    if (!open_flag || cancelled) return -1;
+    if (used_bytes() < n) return 0;
+
+    uint32_t at = tail % UPLOAD_RING_SIZE;
+    size_t first = (n < UPLOAD_RING_SIZE - at) ? n : UPLOAD_RING_SIZE - at;
+    memcpy(buf, ring + at, first);
+    memcpy(buf + first, ring, n - first);
+
+    critical_section_enter_blocking(&upload_lock);
+    tail += n;
+    critical_section_exit(&upload_lock);
+    return (int)n;
+}
@@ -5,11 +5,24 @@
 #include "mqtt.h" // Ensures we can check MQTT status
 #include "sd_card.h"
 #include "json.h"
+#include "cbor.h"
+#include "flash_ops.h"
+#include "spi_diag.h"
+#include "jobs.h"
+#include "auto_mode.h"
+#include "http_parser.h"
+#include "web_assets.h"
+#include "events.h"
+#include "upload.h"
+#include "metrics.h"
+#include "flash_cache.h"
 
 #include "lwip/tcp.h"
 #include "lwip/pbuf.h"
+#include "pico/cyw43_arch.h"
 #include "pico/stdlib.h"
 #include "pico/mutex.h"
+#include <ctype.h>
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
@@ -20,364 +33,1335 @@ extern char json_buffer[JSON_BUFFER_SIZE];
 extern bool sd_ready;
 extern bool spi_initialized;
 extern uint8_t last_jedec_id[3];
-extern mutex_t buffer_mutex;
-extern mutex_t spi_mutex;
+extern recursive_mutex_t buffer_mutex;
+extern recursive_mutex_t spi_mutex;
 
-// We also need access to the diagnostic functions. 
-// Ideally, these should be in spi_ops.h, but if they are in main.c, 
-// they must be non-static.
-extern bool run_spi_diagnostic(char *json_out, size_t json_cap);
-extern bool read_jedec_id(uint8_t *mfr, uint8_t *mem_type, uint8_t *capacity);
+typedef struct http_connection http_connection_t;
 
-typedef struct http_connection {
+// Produces the next piece of a streamed body into buf (at most cap bytes).
+// Returns bytes written, 0 when the body is complete, -1 on error, or
+// HTTP_BODY_WAIT when nothing is ready yet (open-ended streams).
+typedef int (*http_body_fn)(http_connection_t *conn, uint8_t *buf, size_t cap);
+
+#define HTTP_BODY_WAIT (-2)
+
+struct http_connection {
     struct tcp_pcb *pcb;
     bool in_use;
-    uint32_t timestamp;
-} http_connection_t;
+    uint32_t timestamp; // Last activity, for the idle / stall timeouts
+    http_request_t req; // Parser state, accumulates across recv callbacks
+    char response[HTTP_RESPONSE_MAX]; // Handler scratch for in-memory bodies
+
+    // Persistent connection: received bytes wait here until the current
+    // response is done (pipelining); they are only tcp_recved once parsed
+    struct pbuf *pending;
+    bool keep_alive;   // Current response leaves the connection open
+    uint16_t requests; // Requests answered on this connection
+    int8_t route;      // http_routes index of the current request, -1 if none
+    uint32_t start_us; // Current request parsed, for the latency histogram
+
+    // Bus admission (see below)
+    bool parked;        // Request waiting for a busy bus, retried by the service loop
+    uint32_t parked_ms; // When it was parked
+    bool bus_wait;      // Last stream chunk found the bus busy
+
+    // Request body handed to a flash upload job instead of being buffered
+    uint32_t upload_job;  // Job id, 0 when not uploading
+    uint32_t upload_left; // Body bytes not yet passed on
+
+    // Streamed response, pulled from tcp_sent/tcp_poll as the window opens
+    http_body_fn body;
+    uint32_t body_offset; // Body bytes produced so far
+    int32_t body_length;  // Content-Length, or -1 for chunked
+    union {
+        struct {
+            uint8_t report[DIAG_REPORT_MAX];
+            size_t len;
+            bool cbor;
+        } diag;
+        struct {
+            char name[13];
+            uint32_t base; // First byte sent (Range requests)
+        } file;
+        uint32_t flash_addr; // Start of a raw flash range
+        const uint8_t *rom;  // Const data in flash
+        struct {
+            uint32_t cursor;      // Next event to send
+            uint32_t next;        // Cursor after the last batch produced...
+            uint32_t next_offset; // ...valid once body_offset reaches this
+            uint32_t last_ms;     // Last write, for the heartbeat
+        } events;
+        struct {
+            uint32_t piece;       // Next exposition piece to send
+            uint32_t next;        // Same commit scheme as events
+            uint32_t next_offset;
+        } metrics;
+    } src;
+};
 
+// Every per-connection buffer lives in this table, sized at compile time:
+// nothing on the request path touches the heap
 static http_connection_t http_connections[MAX_HTTP_CONNECTIONS];
+static http_pool_stats_t pool_stats;
 static struct tcp_pcb *http_server_pcb;
 static char server_ip[16]; // Local copy of IP for display
 
 // ========== Helper Functions ==========
 
-void cleanup_old_connections(void) {
-    uint32_t now = to_ms_since_boot(get_absolute_time());
-    for (int i = 0; i < MAX_HTTP_CONNECTIONS; i++) {
-        if (http_connections[i].in_use) {
-            if (now - http_connections[i].timestamp > 10000) {
-                if (http_connections[i].pcb) {
-                    tcp_abort(http_connections[i].pcb);
-                }
-                http_connections[i].in_use = false;
-            }
+static uint32_t now_ms(void) {
+    return to_ms_since_boot(get_absolute_time());
+}
+
+static void release_connection(http_connection_t *conn) {
+    if (conn->upload_job) {
+        upload_cancel(); // Job sees the abort, stops and closes the stream
+        conn->upload_job = 0;
+    }
+    if (conn->pending) {
+        pbuf_free(conn->pending);
+        conn->pending = NULL;
+    }
+    conn->body = NULL;
+    conn->parked = false;
+    conn->pcb = NULL;
+    if (conn->in_use) {
+        conn->in_use = false;
+        pool_stats.in_use--;
+    }
+}
+
+// Waiting for the next request with nothing half-received or in flight
+static bool connection_idle(const http_connection_t *conn) {
+    return !conn->body && !conn->pending && conn->req.len == 0;
+}
+
+// Returns ERR_ABRT if the pcb had to be aborted (callers must pass it on)
+static err_t close_connection(http_connection_t *conn) {
+    struct tcp_pcb *pcb = conn->pcb;
+    release_connection(conn);
+    tcp_arg(pcb, NULL);
+    tcp_recv(pcb, NULL);
+    tcp_sent(pcb, NULL);
+    tcp_poll(pcb, NULL, 0);
+    tcp_err(pcb, NULL);
+    if (tcp_close(pcb) != ERR_OK) {
+        tcp_abort(pcb);
+        return ERR_ABRT;
+    }
+    return ERR_OK;
+}
+
+static http_connection_t *register_connection(struct tcp_pcb *pcb) {
+    http_connection_t *conn = NULL;
+    http_connection_t *oldest_idle = NULL;
+
+    for (int i = 0; i < MAX_HTTP_CONNECTIONS && !conn; i++) {
+        http_connection_t *c = &http_connections[i];
+        if (!c->in_use) {
+            conn = c;
+        } else if (connection_idle(c) &&
+                   (!oldest_idle || c->timestamp < oldest_idle->timestamp)) {
+            oldest_idle = c;
         }
     }
+
+    // Table full: a kept-alive connection that is just sitting there gives
+    // way to the new client (browsers reconnect transparently)
+    if (!conn && oldest_idle) {
+        close_connection(oldest_idle);
+        conn = oldest_idle;
+    }
+    if (!conn) {
+        pool_stats.rejected++;
+        return NULL;
+    }
+
+    http_request_reset(&conn->req);
+    conn->pcb = pcb;
+    conn->in_use = true;
+    conn->pending = NULL;
+    conn->keep_alive = false;
+    conn->requests = 0;
+    conn->upload_job = 0;
+    conn->parked = false;
+    conn->bus_wait = false;
+    conn->body = NULL;
+    conn->timestamp = now_ms();
+
+    if (++pool_stats.in_use > pool_stats.in_use_peak) {
+        pool_stats.in_use_peak = pool_stats.in_use;
+    }
+    return conn;
 }
 
-int register_connection(struct tcp_pcb *pcb) {
-    cleanup_old_connections();
-    for (int i = 0; i < MAX_HTTP_CONNECTIONS; i++) {
-        if (!http_connections[i].in_use) {
-            http_connections[i].pcb = pcb;
-            http_connections[i].in_use = true;
-            http_connections[i].timestamp = to_ms_since_boot(get_absolute_time());
-            return i;
+// ========== Response Framing ==========
+
+#define HTTP_NO_BODY (-2) // e.g. 304: no Content-Length / Transfer-Encoding
+
+// Status line + headers. length < 0 means chunked.
+static int format_head(const http_connection_t *conn, char *out, size_t cap,
+                       const char *status, const char *content_type,
+                       const char *extra_headers, int32_t length) {
+    int n = snprintf(out, cap, "HTTP/1.1 %s\r\n", status);
+    if (content_type) {
+        n += snprintf(out + n, cap - n, "Content-Type: %s\r\n", content_type);
+    }
+    if (extra_headers) {
+        n += snprintf(out + n, cap - n, "%s", extra_headers);
+    }
+    if (length >= 0) {
+        n += snprintf(out + n, cap - n, "Content-Length: %ld\r\n", (long)length);
+    } else if (length != HTTP_NO_BODY) {
+        n += snprintf(out + n, cap - n, "Transfer-Encoding: chunked\r\n");
+    }
+    if (conn->keep_alive) {
+        n += snprintf(out + n, cap - n,
+                      "Connection: keep-alive\r\nKeep-Alive: timeout=%d, max=%d\r\n\r\n",
+                      HTTP_KEEPALIVE_TIMEOUT_MS / 1000, HTTP_KEEPALIVE_MAX - conn->requests);
+    } else {
+        n += snprintf(out + n, cap - n, "Connection: close\r\n\r\n");
+    }
+    return n;
+}
+
+// Complete response with a body already in memory
+static void http_send(http_connection_t *conn, const char *status, const char *content_type,
+                      const char *extra_headers, const void *body, size_t len) {
+    char head[320];
+    int n = format_head(conn, head, sizeof(head), status, content_type, extra_headers,
+                        body ? (int32_t)len : HTTP_NO_BODY);
+    tcp_write(conn->pcb, head, n, TCP_WRITE_FLAG_COPY | (len ? TCP_WRITE_FLAG_MORE : 0));
+    if (body == conn->response && len > pool_stats.response_peak) {
+        pool_stats.response_peak = len;
+    }
+    if (body && len) {
+        tcp_write(conn->pcb, body, len, TCP_WRITE_FLAG_COPY);
+    }
+}
+
+static void http_send_text(http_connection_t *conn, const char *status,
+                           const char *content_type, const char *body) {
+    http_send(conn, status, content_type, NULL, body, strlen(body));
+}
+
+static void send_error(http_connection_t *conn, const char *status, const char *message) {
+    char body[96];
+    snprintf(body, sizeof(body), "{\"error\":\"%s\"}", message);
+    http_send_text(conn, status, "application/json", body);
+}
+
+// Response fully queued: keep the connection for the next request or close
+static err_t finish_response(http_connection_t *conn) {
+    metrics_http_request(conn->route, time_us_32() - conn->start_us);
+    conn->body = NULL;
+    if (!conn->keep_alive) {
+        tcp_output(conn->pcb);
+        return close_connection(conn);
+    }
+    http_request_reset(&conn->req);
+    tcp_output(conn->pcb);
+    return ERR_OK;
+}
+
+// ========== Bus Admission ==========
+// lwIP callbacks never wait for spi_mutex, sd_mutex or buffer_mutex: a
+// route names the locks it needs and gets all of them with try-locks
+// before its handler runs, or none. Stream producers do the same per
+// chunk. The mutexes are recursive, so the helpers a handler calls take
+// them again without blocking.
+// A request that finds the bus busy is parked (at most HTTP_BUS_QUEUE of
+// them) and retried from http_server_service for up to HTTP_BUS_WAIT_MS,
+// then answered 503 with Retry-After. A stalled stream just waits.
+
+#define BUS_SPI    0x01
+#define BUS_SD     0x02
+#define BUS_BUFFER 0x04
+
+static bool bus_acquire(http_connection_t *conn, uint8_t locks) {
+    uint8_t held = 0;
+    if ((locks & BUS_SPI) && metrics_try_lock(&spi_mutex, METRICS_LOCK_SPI)) held |= BUS_SPI;
+    if ((locks & BUS_SD) && sd_try_lock()) held |= BUS_SD;
+    if ((locks & BUS_BUFFER) && metrics_try_lock(&buffer_mutex, METRICS_LOCK_BUFFER)) {
+        held |= BUS_BUFFER;
+    }
+
+    conn->bus_wait = (held != locks);
+    if (conn->bus_wait) {
+        if (held & BUS_BUFFER) metrics_unlock(&buffer_mutex, METRICS_LOCK_BUFFER);
+        if (held & BUS_SD) sd_unlock();
+        if (held & BUS_SPI) metrics_unlock(&spi_mutex, METRICS_LOCK_SPI);
+    }
+    return !conn->bus_wait;
+}
+
+static void bus_release(uint8_t locks) {
+    if (locks & BUS_BUFFER) metrics_unlock(&buffer_mutex, METRICS_LOCK_BUFFER);
+    if (locks & BUS_SD) sd_unlock();
+    if (locks & BUS_SPI) metrics_unlock(&spi_mutex, METRICS_LOCK_SPI);
+}
+
+// ========== Streamed Responses ==========
+// Bodies of unknown size go out with chunked transfer encoding, bodies of
+// known size (raw flash) as plain Content-Length data.
+// Each chunk is produced only when the send buffer has room for it, so a
+// response of any size needs just the one HTTP_STREAM_CHUNK scratch buffer
+// (lwIP callbacks all run on core0, one at a time).
+
+#define CHUNK_HEAD_ROOM 8 // "XXXX\r\n" in front of the data
+#define CHUNK_OVERHEAD (CHUNK_HEAD_ROOM + 2)
+
+static uint8_t stream_buf[CHUNK_HEAD_ROOM + HTTP_STREAM_CHUNK + 2];
+
+// Push as many chunks as the send buffer takes, then finish the response
+// once the last one is queued.
+static err_t http_pump(http_connection_t *conn) {
+    struct tcp_pcb *pcb = conn->pcb;
+
+    while (conn->body) {
+        size_t room = tcp_sndbuf(pcb);
+        if (room < CHUNK_OVERHEAD + 64 || tcp_sndqueuelen(pcb) + 2 > TCP_SND_QUEUELEN) {
+            break; // Wait for tcp_sent
+        }
+        bool chunked = (conn->body_length < 0);
+        size_t cap = room - CHUNK_OVERHEAD;
+        if (cap > HTTP_STREAM_CHUNK) cap = HTTP_STREAM_CHUNK;
+        if (!chunked && cap > (uint32_t)conn->body_length - conn->body_offset) {
+            cap = (uint32_t)conn->body_length - conn->body_offset;
+        }
+
+        uint8_t *data = stream_buf + CHUNK_HEAD_ROOM;
+        int n = conn->body(conn, data, cap);
+        if (n == HTTP_BODY_WAIT) {
+            break; // Open-ended stream, nothing new yet
+        }
+
+        if (n < 0 || (n == 0 && !chunked && conn->body_offset < (uint32_t)conn->body_length)) {
+            // Headers are gone already; a reset is the only way to tell the
+            // client the body is incomplete
+            struct tcp_pcb *dead = conn->pcb;
+            release_connection(conn);
+            tcp_arg(dead, NULL);
+            tcp_abort(dead);
+            return ERR_ABRT;
         }
+
+        if (n == 0) {
+            if (chunked) tcp_write(pcb, "0\r\n\r\n", 5, 0);
+            return finish_response(conn);
+        }
+
+        uint8_t *frame = data;
+        size_t frame_len = n;
+        if (chunked) {
+            char head[CHUNK_HEAD_ROOM + 1];
+            int head_len = snprintf(head, sizeof(head), "%X\r\n", n);
+            frame -= head_len;
+            memcpy(frame, head, head_len);
+            data[n] = '\r';
+            data[n + 1] = '\n';
+            frame_len += head_len + 2;
+        }
+
+        if (tcp_write(pcb, frame, frame_len, TCP_WRITE_FLAG_COPY) != ERR_OK) {
+            break; // Chunk is regenerated from body_offset next time
+        }
+        conn->body_offset += n;
     }
-    return -1;
+
+    tcp_output(pcb);
+    return ERR_OK;
 }
 
-void unregister_connection(struct tcp_pcb *pcb) {
-    for (int i = 0; i < MAX_HTTP_CONNECTIONS; i++) {
-        if (http_connections[i].pcb == pcb) {
-            http_connections[i].in_use = false;
-            http_connections[i].pcb = NULL;
-            break;
+// Send the status line + headers and start pulling the body.
+// length < 0 streams chunked; otherwise exactly length bytes are sent.
+static err_t http_stream_start(http_connection_t *conn, const char *status,
+                               const char *content_type, const char *extra_headers,
+                               int32_t length, http_body_fn body) {
+    char head[320];
+    int n = format_head(conn, head, sizeof(head), status, content_type, extra_headers,
+                        length);
+    tcp_write(conn->pcb, head, n, TCP_WRITE_FLAG_COPY);
+
+    conn->body = body;
+    conn->body_offset = 0;
+    conn->body_length = length;
+    return http_pump(conn);
+}
+
+#define http_stream_begin(conn, status, type, extra, body) \
+    http_stream_start((conn), (status), (type), (extra), -1, (body))
+
+// Body: const data (embedded web assets), copied only when it didn't fit
+// the send buffer in one go
+static int body_rom(http_connection_t *conn, uint8_t *buf, size_t cap) {
+    memcpy(buf, conn->src.rom + conn->body_offset, cap);
+    return (int)cap;
+}
+
+// Complete response whose body lives in flash (XIP, never changes), so
+// lwIP can reference it in place instead of copying it into pbufs
+static err_t http_send_static(http_connection_t *conn, const char *status,
+                              const char *content_type, const char *extra_headers,
+                              const uint8_t *data, uint32_t len) {
+    char head[320];
+    int n = format_head(conn, head, sizeof(head), status, content_type, extra_headers,
+                        (int32_t)len);
+    tcp_write(conn->pcb, head, n, TCP_WRITE_FLAG_COPY | TCP_WRITE_FLAG_MORE);
+    if (tcp_write(conn->pcb, data, len, 0) == ERR_OK) {
+        return ERR_OK;
+    }
+
+    // Send buffer busy (pipelined responses ahead of us): stream it
+    conn->src.rom = data;
+    conn->body = body_rom;
+    conn->body_offset = 0;
+    conn->body_length = (int32_t)len;
+    return http_pump(conn);
+}
+
+// Body: diagnostic report re-rendered from the sweep captured at request
+// time, a window at a time
+static int body_diag_report(http_connection_t *conn, uint8_t *buf, size_t cap) {
+    window_sink_t win;
+    window_sink_init(&win, conn->body_offset, buf, cap);
+
+    if (conn->src.diag.cbor) {
+        cbor_stream_full_report(&win.base, conn->src.diag.report, conn->src.diag.len);
+    } else {
+        json_stream_full_report(&win.base, conn->src.diag.report, conn->src.diag.len);
+    }
+    return (int)win.used;
+}
+
+// Body: SD file, read straight into the chunk at the current offset
+static int body_sd_file(http_connection_t *conn, uint8_t *buf, size_t cap) {
+    if (!bus_acquire(conn, BUS_SD)) return HTTP_BODY_WAIT;
+    int n = sd_read_binary_safe(conn->src.file.name, conn->src.file.base + conn->body_offset,
+                                buf, cap);
+    bus_release(BUS_SD);
+    return n;
+}
+
+// Body: raw flash contents, one SPI read per chunk
+static int body_flash_range(http_connection_t *conn, uint8_t *buf, size_t cap) {
+    if (!bus_acquire(conn, BUS_SPI)) return HTTP_BODY_WAIT;
+    bool ok = flash_read_bytes(conn->src.flash_addr + conn->body_offset, buf, cap);
+    bus_release(BUS_SPI);
+    return ok ? (int)cap : -1;
+}
+
+// Body: hex viewer page through the sector cache
+static int body_flash_cached(http_connection_t *conn, uint8_t *buf, size_t cap) {
+    if (!bus_acquire(conn, BUS_SPI)) return HTTP_BODY_WAIT; // Only a miss needs it, but cheap
+    bool ok = flash_cache_read(conn->src.flash_addr + conn->body_offset, buf, cap);
+    bus_release(BUS_SPI);
+    return ok ? (int)cap : -1;
+}
+
+// Body: Server-Sent Events from the shared event ring. The cursor only
+// moves on once the previous batch was actually queued (body_offset caught
+// up), because the pump regenerates a batch that tcp_write refused.
+static int body_events(http_connection_t *conn, uint8_t *buf, size_t cap) {
+    if (conn->body_offset == conn->src.events.next_offset) {
+        conn->src.events.cursor = conn->src.events.next;
+    }
+    uint32_t cursor = conn->src.events.cursor;
+    uint32_t now = now_ms();
+    size_t n = 0;
+
+    event_t ev;
+    uint32_t lost;
+    // Worst case per event: a "lost" notice plus a full-size record
+    while (cap - n >= sizeof(ev.data) + 96 && events_read(&cursor, &ev, &lost)) {
+        if (lost) {
+            // Lapped by the producer: say so instead of silently skipping
+            n += snprintf((char *)buf + n, cap - n, "event: lost\ndata: {\"count\":%lu}\n\n",
+                          (unsigned long)lost);
+        }
+        n += snprintf((char *)buf + n, cap - n, "id: %lu\nevent: %s\ndata: %s\n\n",
+                      (unsigned long)ev.seq, ev.name, ev.data);
+    }
+
+    if (n == 0) {
+        if (now - conn->src.events.last_ms < EVENTS_HEARTBEAT_MS) {
+            return HTTP_BODY_WAIT;
+        }
+        // Comment line: keeps proxies and the stall timeout happy
+        n = snprintf((char *)buf, cap, ": ping\n\n");
+    }
+
+    conn->src.events.next = cursor;
+    conn->src.events.next_offset = conn->body_offset + n;
+    conn->src.events.last_ms = now;
+    return (int)n;
+}
+
+// Body: Prometheus exposition, whole pieces only (see metrics.h) so no
+// line is split between two readings of the counters. Committed the same
+// way as body_events.
+static int body_metrics(http_connection_t *conn, uint8_t *buf, size_t cap) {
+    if (conn->body_offset == conn->src.metrics.next_offset) {
+        conn->src.metrics.piece = conn->src.metrics.next;
+    }
+    uint32_t piece = conn->src.metrics.piece;
+    uint32_t total = metrics_piece_count();
+    size_t n = 0;
+
+    while (piece < total) {
+        mem_sink_t mem;
+        mem_sink_init(&mem, (char *)buf + n, cap - n);
+        if (!metrics_write_piece(&mem.base, piece)) {
+            break; // Goes in the next chunk
         }
+        n += mem.base.written;
+        piece++;
+    }
+    if (n == 0 && piece < total) {
+        return HTTP_BODY_WAIT; // Send buffer nearly full; a piece always fits a whole chunk
+    }
+
+    conn->src.metrics.next = piece;
+    conn->src.metrics.next_offset = conn->body_offset + n;
+    return (int)n;
+}
+
+// Quoted ETag; each encoding of the same sweep gets its own tag
+static void format_etag(char *out, size_t cap, uint32_t etag, bool cbor) {
+    snprintf(out, cap, "\"%08lX%s\"", (unsigned long)etag, cbor ? "-cbor" : "");
+}
+
+// Check a conditional GET's If-None-Match header against our ETag
+static bool etag_matches(const http_request_t *req, const char *etag_str) {
+    const char *hdr = http_request_header(req, "If-None-Match");
+    return hdr && strncmp(hdr, etag_str, strlen(etag_str)) == 0;
+}
+
+// ?format=cbor selects the binary report encoding
+static bool wants_cbor(const http_request_t *req) {
+    char format[8];
+    return http_request_query(req, "format", format, sizeof(format)) &&
+           strcmp(format, "cbor") == 0;
+}
+
+// SD file names from the query string: 8.3, no paths
+static bool valid_file_name(const char *name) {
+    return name[0] != '\0' && strlen(name) <= 12 && !strchr(name, '/') &&
+           !strchr(name, '\\') && !strstr(name, "..");
+}
+
+
+// ========== Route Handlers ==========
+// Each handler either answers with http_send() (using `response`, the
+// slot's HTTP_RESPONSE_MAX scratch buffer) and returns ERR_OK, or starts
+// a streamed body with http_stream_begin() and returns its result.
+
+typedef err_t (*route_handler_t)(http_connection_t *conn, const http_request_t *req,
+                                 char *response);
+
+// Static UI: gzipped at build time, served straight from flash. All
+// dynamic state comes from /api/status, so the page itself is cacheable.
+static err_t handle_index(http_connection_t *conn, const http_request_t *req, char *response) {
+    const web_asset_t *asset = &web_index_html;
+    char headers[160];
+    snprintf(headers, sizeof(headers),
+             "ETag: %s\r\nCache-Control: public, max-age=%d\r\n"
+             "Content-Encoding: gzip\r\nVary: Accept-Encoding\r\n",
+             asset->etag, WEB_ASSET_MAX_AGE);
+
+    if (etag_matches(req, asset->etag)) {
+        http_send(conn, "304 Not Modified", NULL, headers, NULL, 0);
+        return ERR_OK;
     }
+    // Every browser accepts gzip; there is no identity copy to fall back to
+    return http_send_static(conn, "200 OK", asset->content_type, headers, asset->data,
+                            asset->len);
 }
 
-void generate_html_page(char *output, size_t size) {
-    char chip_info[128] = "Not scanned";
+// Live device state for the UI header
+static err_t handle_status(http_connection_t *conn, const http_request_t *req, char *response) {
+    char jedec[9] = "null";
     if (last_jedec_id[0] != 0xFF) {
-        snprintf(chip_info, sizeof(chip_info),
-                 "MFR: 0x%02X | Type: 0x%02X | Cap: 0x%02X", 
-                 last_jedec_id[0], last_jedec_id[1], last_jedec_id[2]);
-    }
-    snprintf(
-      output, size,
-      "HTTP/1.1 200 OK\r\n"
-      "Content-Type: text/html\r\n"
-      "Connection: close\r\n\r\n"
-      "<!DOCTYPE html>\n"
-      "<html>\n"
-      "<head>\n"
-      "  <meta charset='utf-8'>\n"
-      "  <meta name='viewport' content='width=device-width, initial-scale=1'>\n"
-      "  <title>SPI Flash Diagnostics</title>\n"
-      "  <style>\n"
-      "    * { margin: 0; padding: 0; box-sizing: border-box; }\n"
-      "    body { font-family: system-ui, sans-serif; background: #0f172a; "
-      "color: #e2e8f0; padding: 20px; }\n"
-      "    .container { max-width: 1200px; margin: 0 auto; }\n"
-      "    .header { background: linear-gradient(135deg, #3b82f6 0%%, #8b5cf6 "
-      "100%%); padding: 30px; border-radius: 12px; margin-bottom: 20px; }\n"
-      "    h1 { font-size: 28px; margin-bottom: 10px; }\n"
-      "    .status { font-size: 14px; opacity: 0.9; }\n"
-      "    .card { background: #1e293b; padding: 25px; border-radius: 12px; "
-      "margin-bottom: 20px; }\n"
-      "    .card h2 { color: #60a5fa; margin-bottom: 15px; }\n"
-      "    .btn { padding: 12px 24px; background: #3b82f6; color: white; "
-      "border: none; border-radius: 8px; cursor: pointer; font-size: 14px; "
-      "font-weight: 500; }\n"
-      "    .btn:hover { background: #2563eb; }\n"
-      "    .btn:disabled { background: #475569; cursor: not-allowed; }\n"
-      "    .btn-group { display: flex; gap: 10px; flex-wrap: wrap; }\n"
-      "    pre { background: #0f172a; padding: 20px; border-radius: 8px;"
-      "white-space: pre-wrap; word-wrap: break-word; "
-      "overflow-x: auto; font-size: 14px; max-height: 80vh;min-height: 300px ;overflow-y: auto; "
-      "}\n"
-      "    .info { color: #94a3b8; font-size: 14px; margin-top: 10px; }\n"
-      "    .loading { display: none; color: #60a5fa; }\n"
-      "    .loading.active { display: inline; }\n"
-      "  </style>\n"
-      "</head>\n"
-      "<body>\n"
-      "  <div class='container'>\n"
-      "    <div class='header'>\n"
-      "      <h1>SPI Flash Diagnostic Tool</h1>\n"
-      "      <div class='status'>IP: %s | SPI: %s | SD: %s | MQTT: %s</div>\n"
-      "    </div>\n"
-      "    <div class='card'>\n"
-      "      <h2>Quick Identification</h2>\n"
-      "      <div class='btn-group'>\n"
-      "        <button class='btn' onclick='scanJedec()'>Read JEDEC "
-      "ID</button>\n"
-      "        <span class='loading' id='jedecLoading'>Reading...</span>\n"
-      "      </div>\n"
-      "      <div class='info' id='jedecInfo'>%s</div>\n"
-      "    </div>\n"
-      "    <div class='card'>\n"
-      "      <h2>Full Diagnostic Report</h2>\n"
-      "      <div class='btn-group'>\n"
-      "        <button class='btn' onclick='runFullScan()'>Run Full "
-      "Scan</button>\n"
-      "        <button class='btn' onclick='downloadReport()'>Download "
-      "JSON</button>\n"
-      "        <button class='btn' onclick='publishMqtt()' %s>Publish via "
-      "MQTT</button>\n"
-      "        <span class='loading' id='scanLoading'>Scanning...</span>\n"
-      "      </div>\n"
-      "      <pre id='reportData'>Click \"Run Full Scan\" to begin...</pre>\n"
-      "    </div>\n"
-      "    <div class='card'>\n"
-      "      <h2>Saved Reports</h2>\n"
-      "      <div class='btn-group'>\n"
-      "        <button class='btn' onclick='viewReport(\"latest.jsn\")'>View "
-      "Latest</button>\n"
-      "      </div>\n"
-      "      <div class='info'>Reports are automatically saved to SD "
-      "card</div>\n"
-      "    </div>\n"
-      "  </div>\n"
-      "  <script>\n"
-      "    async function scanJedec() {\n"
-      "      document.getElementById('jedecLoading').classList.add('active');\n"
-      "      const resp = await fetch('/api/jedec');\n"
-      "      const data = await resp.json();\n"
-      "      "
-      "document.getElementById('jedecLoading').classList.remove('active');\n"
-      "      if (data.error) {\n"
-      "        document.getElementById('jedecInfo').textContent = 'Error: ' + "
-      "data.error;\n"
-      "      } else {\n"
-      "        document.getElementById('jedecInfo').textContent = \n"
-      "          `Manufacturer: 0x${data.manufacturer} | Memory Type: "
-      "0x${data.memory_type} | Capacity: 0x${data.capacity}`;\n"
-      "      }\n"
-      "    }\n"
-      "    async function runFullScan() {\n"
-      "      document.getElementById('scanLoading').classList.add('active');\n"
-      "      document.getElementById('reportData').textContent = 'Scanning "
-      "flash memory...';\n"
-      "      const resp = await fetch('/api/scan');\n"
-      "      const data = await resp.text();\n"
-      "      "
-      "document.getElementById('scanLoading').classList.remove('active');\n"
-      "      document.getElementById('reportData').textContent = data;\n"
-      "    }\n"
-      "    async function downloadReport() {\n"
-      "      window.location.href = '/api/download';\n"
-      "    }\n"
-      "    async function publishMqtt() {\n"
-      "      const resp = await fetch('/api/publish');\n"
-      "      const data = await resp.json();\n"
-      "      alert(data.message || data.error);\n"
-      "    }\n"
-      "    async function viewReport(filename) {\n"
-      "      const resp = await fetch(`/api/view?file=${filename}`);\n"
-      "      const data = await resp.text();\n"
-      "      document.getElementById('reportData').textContent = data;\n"
-      "    }\n"
-      "  </script>\n"
-      "</body>\n"
-      "</html>",
-      server_ip, spi_initialized ? "Ready" : "Not Init",
-      sd_ready ? "Ready" : "No Card", mqtt_is_connected() ? "Connected" : "Offline",
-      chip_info, mqtt_is_connected() ? "" : "disabled");
-}
-
-// ========== Request Handler ==========
+        snprintf(jedec, sizeof(jedec), "\"%02X%02X%02X\"", last_jedec_id[0], last_jedec_id[1],
+                 last_jedec_id[2]);
+    }
+    int n = snprintf(response, HTTP_RESPONSE_MAX,
+                     "{\"ip\":\"%s\",\"spi\":%s,\"sd\":%s,\"mqtt\":%s,\"jedec\":%s,"
+                     "\"uptime_ms\":%lu,\"http\":{\"slots\":%d,\"in_use\":%u,\"in_use_peak\":%u,"
+                     "\"rejected\":%lu,\"request_peak\":%u,\"request_max\":%d,"
+                     "\"response_peak\":%u,\"response_max\":%d}}",
+                     server_ip, spi_initialized ? "true" : "false", sd_ready ? "true" : "false",
+                     mqtt_is_connected() ? "true" : "false", jedec, (unsigned long)now_ms(),
+                     MAX_HTTP_CONNECTIONS, pool_stats.in_use, pool_stats.in_use_peak,
+                     (unsigned long)pool_stats.rejected, pool_stats.request_peak,
+                     HTTP_REQUEST_MAX, pool_stats.response_peak, HTTP_RESPONSE_MAX);
+    http_send(conn, "200 OK", "application/json", "Cache-Control: no-store\r\n", response, n);
+    return ERR_OK;
+}
 
-static err_t http_recv(void *arg, struct tcp_pcb *pcb, struct pbuf *p, err_t err) {
-    if (p == NULL) {
-        unregister_connection(pcb);
-        tcp_close(pcb);
+static err_t handle_jedec(http_connection_t *conn, const http_request_t *req, char *response) {
+    uint8_t mfr, mem_type, capacity;
+    if (read_jedec_id(&mfr, &mem_type, &capacity)) {
+        snprintf(response, HTTP_RESPONSE_MAX,
+                 "{\"manufacturer\":\"%02X\",\"memory_type\":\"%02X\",\"capacity\":\"%02X\"}",
+                 mfr, mem_type, capacity);
+        http_send_text(conn, "200 OK", "application/json", response);
+    } else {
+        send_error(conn, "500 Internal Server Error", "Read Failed");
+    }
+    return ERR_OK;
+}
+
+// Full scan (full sweep only when the chip fingerprint changed)
+static err_t handle_scan(http_connection_t *conn, const http_request_t *req, char *response) {
+    bool cbor = wants_cbor(req);
+    diag_status_t status = spi_diag_refresh();
+    char etag[20];
+    format_etag(etag, sizeof(etag), spi_diag_etag(), cbor);
+
+    char headers[64];
+    snprintf(headers, sizeof(headers), "ETag: %s\r\nCache-Control: no-cache\r\n", etag);
+
+    if (status != DIAG_ERROR && etag_matches(req, etag)) {
+        // Client already has this report: no render, no SD write
+        http_send(conn, "304 Not Modified", NULL, headers, NULL, 0);
         return ERR_OK;
     }
 
-    // Allocate buffers
-    char *request = malloc(p->tot_len + 1);
-    char *response = malloc(HTML_BUFFER_SIZE);
+    if (status == DIAG_UPDATED) {
+        spi_diag_save_reports();
+    }
 
-    if (!request || !response) {
-        if (request) free(request);
-        if (response) free(response);
-        pbuf_free(p);
-        tcp_abort(pcb);
-        return ERR_ABRT;
+    // Capture the sweep now; the body is rendered from this copy as the
+    // send window opens, so a refresh on core1 can't change it mid-stream
+    conn->src.diag.len = spi_diag_snapshot(conn->src.diag.report);
+    conn->src.diag.cbor = cbor;
+
+    if (conn->src.diag.len == 0) {
+        mem_sink_t mem;
+        mem_sink_init(&mem, response, HTTP_RESPONSE_MAX);
+        spi_diag_stream_json(&mem.base); // Error object
+        http_send_text(conn, "500 Internal Server Error", "application/json", response);
+        return ERR_OK;
     }
 
-    pbuf_copy_partial(p, request, p->tot_len, 0);
-    request[p->tot_len] = '\0';
+    return http_stream_begin(conn, "200 OK", cbor ? "application/cbor" : "application/json",
+                             headers, body_diag_report);
+}
 
-    // ================== ROUTING LOGIC ==================
+// Send `size` bytes of a resource, or the part a Range header asks for
+// (206). On success conn's body starts at *start within the resource; the
+// caller has set up the producer's base accordingly via `base`.
+static err_t stream_ranged(http_connection_t *conn, const http_request_t *req, uint32_t size,
+                           const char *content_type, const char *extra_headers,
+                           uint32_t *base, http_body_fn body) {
+    uint32_t start = 0, len = size;
+    char headers[192];
+    int n = snprintf(headers, sizeof(headers), "%sAccept-Ranges: bytes\r\n",
+                     extra_headers ? extra_headers : "");
 
-    // 1. Root / Index
-    if (strstr(request, "GET / ") || strstr(request, "GET /index")) {
-        generate_html_page(response, HTML_BUFFER_SIZE);
-        tcp_write(pcb, response, strlen(response), TCP_WRITE_FLAG_COPY);
-    
-    // 2. JEDEC ID
-    } else if (strstr(request, "GET /api/jedec")) {
-        uint8_t mfr, mem_type, capacity;
-        if (read_jedec_id(&mfr, &mem_type, &capacity)) {
-            snprintf(response, HTML_BUFFER_SIZE,
-                     "HTTP/1.1 200 OK\r\nContent-Type: application/json\r\n\r\n"
-                     "{\"manufacturer\":\"%02X\",\"memory_type\":\"%02X\",\"capacity\":\"%02X\"}",
-                     mfr, mem_type, capacity);
-        } else {
-             snprintf(response, HTML_BUFFER_SIZE, "HTTP/1.1 500 Internal Server Error\r\n\r\n{\"error\":\"Read Failed\"}");
+    http_range_t range = http_request_range(req, size, &start, &len);
+    if (range == HTTP_RANGE_UNSATISFIABLE) {
+        snprintf(headers + n, sizeof(headers) - n, "Content-Range: bytes */%lu\r\n",
+                 (unsigned long)size);
+        http_send(conn, "416 Range Not Satisfiable", NULL, headers, "", 0);
+        return ERR_OK;
+    }
+    if (range == HTTP_RANGE_OK) {
+        snprintf(headers + n, sizeof(headers) - n, "Content-Range: bytes %lu-%lu/%lu\r\n",
+                 (unsigned long)start, (unsigned long)(start + len - 1), (unsigned long)size);
+    }
+
+    *base += start;
+    return http_stream_start(conn, range == HTTP_RANGE_OK ? "206 Partial Content" : "200 OK",
+                             content_type, headers, (int32_t)len, body);
+}
+
+// SD file with Content-Length, resumable with Range (f_lseek per chunk)
+static err_t stream_sd_file(http_connection_t *conn, const http_request_t *req,
+                            const char *file, const char *content_type,
+                            const char *extra_headers) {
+    int32_t size = sd_ready ? sd_file_size_safe(file) : -1;
+    if (size < 0) {
+        send_error(conn, "404 Not Found", "File not found");
+        return ERR_OK;
+    }
+
+    strncpy(conn->src.file.name, file, sizeof(conn->src.file.name) - 1);
+    conn->src.file.name[sizeof(conn->src.file.name) - 1] = '\0';
+    conn->src.file.base = 0;
+    return stream_ranged(conn, req, (uint32_t)size, content_type, extra_headers,
+                         &conn->src.file.base, body_sd_file);
+}
+
+static err_t handle_download(http_connection_t *conn, const http_request_t *req, char *response) {
+    bool cbor = wants_cbor(req);
+    const char *file = cbor ? REPORT_FILE_CBOR : REPORT_FILE_JSON;
+
+    if (!sd_ready || sd_file_size_safe(file) <= 0) {
+        http_send_text(conn, "404 Not Found", "text/plain", "File not found. Run a scan first.");
+        return ERR_OK;
+    }
+
+    // Streamed from SD a chunk at a time: no json_buffer, no size cap
+    return stream_sd_file(conn, req, file, cbor ? "application/cbor" : "application/json",
+                          cbor ? "Content-Disposition: attachment; filename=\"report.cbor\"\r\n"
+                               : "Content-Disposition: attachment; filename=\"report.json\"\r\n");
+}
+
+static err_t handle_publish(http_connection_t *conn, const http_request_t *req, char *response) {
+    if (!mqtt_is_connected() && !sd_ready) {
+        send_error(conn, "503 Service Unavailable", "MQTT Not Connected");
+        return ERR_OK;
+    }
+
+    if (mqtt_publish_busy()) {
+        send_error(conn, "503 Service Unavailable", "Previous report still publishing");
+        return ERR_OK;
+    }
+
+    // Sent from the SD file in chunks by the core0 service pass, any size;
+    // offline it waits in the MQTT journal
+    bool cbor = wants_cbor(req);
+    bool online = mqtt_is_connected();
+    if (sd_ready && mqtt_publish_file(cbor ? MQTT_TOPIC_CBOR : MQTT_TOPIC,
+                                      cbor ? REPORT_FILE_CBOR : REPORT_FILE_JSON)) {
+        http_send_text(conn, "200 OK", "application/json",
+                       online ? "{\"message\":\"Published\"}"
+                              : "{\"message\":\"Queued until MQTT reconnects\"}");
+    } else {
+        send_error(conn, "500 Internal Server Error",
+                   online ? "No report file found on SD" : "No report file, or the MQTT journal is full");
+    }
+    return ERR_OK;
+}
+
+// Submit async job (runs on core1, returns immediately)
+static err_t handle_job_submit(http_connection_t *conn, const http_request_t *req, char *response) {
+    char type_str[8] = "";
+    char num[16];
+    char file[13] = "";
+    uint32_t addr = 0, len = 0;
+
+    http_request_query(req, "type", type_str, sizeof(type_str));
+    if (http_request_query(req, "addr", num, sizeof(num))) addr = strtoul(num, NULL, 0);
+    if (http_request_query(req, "len", num, sizeof(num))) len = strtoul(num, NULL, 0);
+    http_request_query(req, "file", file, sizeof(file));
+
+    job_type_t type = job_type_from_name(type_str);
+    if (type == JOB_TYPE_COUNT || type == JOB_UPLOAD || (file[0] && !valid_file_name(file))) {
+        send_error(conn, "400 Bad Request",
+                   "type must be scan, dump, hash, erase, flash or blank");
+        return ERR_OK;
+    }
+
+    uint32_t id = jobs_submit(type, addr, len, file);
+    if (id == 0) {
+        http_send_text(conn, "503 Service Unavailable", "application/json",
+                       "{\"error\":\"Job queue full\"}");
+        return ERR_OK;
+    }
+
+    char location[40];
+    snprintf(location, sizeof(location), "Location: /api/jobs/%lu\r\n", (unsigned long)id);
+    int n = snprintf(response, HTTP_RESPONSE_MAX, "{\"id\":%lu,\"state\":\"queued\"}",
+                     (unsigned long)id);
+    http_send(conn, "202 Accepted", "application/json", location, response, n);
+    return ERR_OK;
+}
+
+// Job status (/api/jobs/<id>) or list (/api/jobs)
+static err_t handle_job_status(http_connection_t *conn, const http_request_t *req, char *response) {
+    const char *id_str = req->path + strlen("/api/jobs");
+    size_t body_len;
+
+    if (*id_str == '/') {
+        job_t job;
+        uint32_t id = strtoul(id_str + 1, NULL, 10);
+        body_len = jobs_get(id, &job) ? jobs_format_json(&job, response, HTTP_RESPONSE_MAX) : 0;
+        if (body_len == 0) {
+            send_error(conn, "404 Not Found", "Unknown job");
+            return ERR_OK;
+        }
+    } else {
+        body_len = jobs_format_list(response, HTTP_RESPONSE_MAX);
+    }
+    http_send(conn, "200 OK", "application/json", "Cache-Control: no-store\r\n",
+              response, body_len);
+    return ERR_OK;
+}
+
+// Chip size from the JEDEC capacity code, 0 if unknown. Reads use 3-byte
+// addresses, so anything past 16 MB is out of reach.
+static uint32_t chip_size_bytes(void) {
+    uint8_t mfr, type, cap;
+    if (!read_jedec_id(&mfr, &type, &cap) || cap < 8 || cap > 31) {
+        return 0;
+    }
+    return (cap > 24) ? (1u << 24) : (1u << cap);
+}
+
+// Production auto mode control
+static err_t handle_auto_control(http_connection_t *conn, const http_request_t *req, char *response) {
+    char val[48];
+    bool ok = true;
+
+    if (http_request_query(req, "enable", val, sizeof(val)) && val[0] == '0') {
+        auto_mode_stop();
+    } else {
+        auto_config_t cfg;
+        auto_mode_default_config(&cfg);
+        if (http_request_query(req, "steps", val, sizeof(val))) {
+            cfg.steps = auto_mode_parse_steps(val);
+            ok = (cfg.steps != 0);
         }
-        tcp_write(pcb, response, strlen(response), TCP_WRITE_FLAG_COPY);
-
-    // 3. Full Scan
-    } else if (strstr(request, "GET /api/scan")) {
-        mutex_enter_blocking(&buffer_mutex);
-        bool success = run_spi_diagnostic(json_buffer, JSON_BUFFER_SIZE);
-        
-        // Save to SD card if successful
-        if (success && sd_ready) {
-            sd_write_safe("latest.jsn", json_buffer);
+        if (http_request_query(req, "addr", val, sizeof(val))) {
+            // Bounded by the chip in the socket, if there is one; units
+            // inserted later are checked again by the pipeline
+            char *end;
+            uint32_t chip = chip_size_bytes();
+            cfg.addr = strtoul(val, &end, 0);
+            ok = ok && end != val && *end == '\0' && isdigit((unsigned char)val[0]) &&
+                 cfg.addr % FLASH_SECTOR_SIZE == 0 && (chip == 0 || cfg.addr < chip);
         }
-        
-        snprintf(response, HTML_BUFFER_SIZE, "HTTP/1.1 200 OK\r\nContent-Type: application/json\r\n\r\n%s", json_buffer);
-        mutex_exit(&buffer_mutex);
-        tcp_write(pcb, response, strlen(response), TCP_WRITE_FLAG_COPY);
-
-    // 4. Download JSON (This was missing!)
-    } else if (strstr(request, "GET /api/download")) {
-        mutex_enter_blocking(&buffer_mutex);
-        
-        // Attempt to read the latest report
-        bool file_read = false;
-        if (sd_ready) {
-            // Assuming sd_read_safe returns true on success
-            file_read = sd_read_safe("latest.jsn", json_buffer, JSON_BUFFER_SIZE);
+        if (http_request_query(req, "file", val, sizeof(val))) {
+            ok = ok && valid_file_name(val);
+            strncpy(cfg.file, val, sizeof(cfg.file) - 1);
         }
+        if (http_request_query(req, "jedec", val, sizeof(val))) {
+            ok = ok && strlen(val) == 6 && strspn(val, "0123456789abcdefABCDEF") == 6;
+            uint32_t id = strtoul(val, NULL, 16);
+            cfg.expect_jedec[0] = (id >> 16) & 0xFF;
+            cfg.expect_jedec[1] = (id >> 8) & 0xFF;
+            cfg.expect_jedec[2] = id & 0xFF;
+        }
+        if (ok) auto_mode_start(&cfg);
+    }
 
-        if (file_read) {
-            // Write headers first
-            int header_len = snprintf(response, HTML_BUFFER_SIZE,
-                     "HTTP/1.1 200 OK\r\n"
-                     "Content-Type: application/json\r\n"
-                     "Content-Disposition: attachment; filename=\"report.json\"\r\n"
-                     "Connection: close\r\n\r\n");
-            
-            tcp_write(pcb, response, header_len, TCP_WRITE_FLAG_COPY);
-            // Write body directly from json_buffer to avoid stack overflow in response buffer
-            tcp_write(pcb, json_buffer, strlen(json_buffer), TCP_WRITE_FLAG_COPY);
-        } else {
-            snprintf(response, HTML_BUFFER_SIZE, "HTTP/1.1 404 Not Found\r\n\r\nFile not found. Run a scan first.");
-            tcp_write(pcb, response, strlen(response), TCP_WRITE_FLAG_COPY);
+    if (ok) {
+        http_send_text(conn, "202 Accepted", "application/json",
+                       "{\"message\":\"Auto mode updated\"}");
+    } else {
+        send_error(conn, "400 Bad Request",
+                   "steps: identify,blank,hash,program,verify; file: 8.3 name; "
+                   "addr: sector aligned, on the chip; jedec: 6 hex digits");
+    }
+    return ERR_OK;
+}
+
+static err_t handle_auto_status(http_connection_t *conn, const http_request_t *req, char *response) {
+    size_t n = auto_mode_format_json(response, HTTP_RESPONSE_MAX);
+    http_send(conn, "200 OK", "application/json", "Cache-Control: no-store\r\n", response, n);
+    return ERR_OK;
+}
+
+// Start a raw octet-stream of [addr, addr + len); len 0 = to end of chip.
+// A Range header then selects bytes within that window.
+static err_t stream_flash_range(http_connection_t *conn, const http_request_t *req,
+                                char *response, uint32_t addr, uint32_t len,
+                                const char *extra_headers) {
+    uint32_t chip = chip_size_bytes();
+
+    if (chip == 0 || addr >= chip || len > chip - addr) {
+        snprintf(response, HTTP_RESPONSE_MAX,
+                 "{\"error\":\"Range outside chip\",\"chip_size\":%lu}", (unsigned long)chip);
+        http_send_text(conn, "416 Range Not Satisfiable", "application/json", response);
+        return ERR_OK;
+    }
+    if (len == 0) {
+        len = chip - addr;
+    }
+
+    conn->src.flash_addr = addr;
+    return stream_ranged(conn, req, len, "application/octet-stream", extra_headers,
+                         &conn->src.flash_addr, body_flash_range);
+}
+
+// Live event stream. Reconnecting browsers send Last-Event-ID and resume
+// from there if the ring still holds it.
+static err_t handle_events(http_connection_t *conn, const http_request_t *req, char *response) {
+    int subscribers = 0;
+    for (int i = 0; i < MAX_HTTP_CONNECTIONS; i++) {
+        if (http_connections[i].in_use && http_connections[i].body == body_events) {
+            subscribers++;
+        }
+    }
+    if (subscribers >= EVENTS_MAX_SUBSCRIBERS) {
+        const char *body = "{\"error\":\"Too many event streams\"}";
+        http_send(conn, "503 Service Unavailable", "application/json", "Retry-After: 10\r\n",
+                  body, strlen(body));
+        return ERR_OK;
+    }
+
+    const char *last_id = http_request_header(req, "Last-Event-ID");
+    uint32_t cursor = last_id ? strtoul(last_id, NULL, 10) + 1 : events_head();
+
+    conn->keep_alive = false; // The stream only ends when the client leaves
+    conn->src.events.cursor = conn->src.events.next = cursor;
+    conn->src.events.next_offset = 0;
+    conn->src.events.last_ms = now_ms();
+    return http_stream_begin(conn, "200 OK", "text/event-stream",
+                             "Cache-Control: no-cache\r\n", body_events);
+}
+
+// Prometheus scrape target
+static err_t handle_metrics(http_connection_t *conn, const http_request_t *req, char *response) {
+    conn->src.metrics.piece = conn->src.metrics.next = 0;
+    conn->src.metrics.next_offset = 0;
+    return http_stream_begin(conn, "200 OK", "text/plain; version=0.0.4",
+                             "Cache-Control: no-store\r\n", body_metrics);
+}
+
+// Raw flash range: /api/flash?addr=&len=
+static err_t handle_flash_read(http_connection_t *conn, const http_request_t *req, char *response) {
+    char num[16];
+    uint32_t addr = 0, len = 0;
+
+    if (http_request_query(req, "addr", num, sizeof(num))) addr = strtoul(num, NULL, 0);
+    if (http_request_query(req, "len", num, sizeof(num))) len = strtoul(num, NULL, 0);
+
+    return stream_flash_range(conn, req, response, addr, len, NULL);
+}
+
+// Hex viewer page: /api/read?addr=&len= (len up to FLASH_READ_MAX, clipped
+// at the end of the chip). Served from the sector cache; whole-chip dumps
+// stay on /api/flash so they don't flush it.
+static err_t handle_read(http_connection_t *conn, const http_request_t *req, char *response) {
+    char num[16];
+    uint32_t addr = 0, len = FLASH_READ_MAX;
+
+    if (http_request_query(req, "addr", num, sizeof(num))) addr = strtoul(num, NULL, 0);
+    if (http_request_query(req, "len", num, sizeof(num))) len = strtoul(num, NULL, 0);
+
+    if (len == 0 || len > FLASH_READ_MAX) {
+        send_error(conn, "400 Bad Request", "len must be 1..4096");
+        return ERR_OK;
+    }
+    uint32_t chip = chip_size_bytes();
+    if (chip == 0 || addr >= chip) {
+        snprintf(response, HTTP_RESPONSE_MAX,
+                 "{\"error\":\"Range outside chip\",\"chip_size\":%lu}", (unsigned long)chip);
+        http_send_text(conn, "416 Range Not Satisfiable", "application/json", response);
+        return ERR_OK;
+    }
+    if (len > chip - addr) {
+        len = chip - addr;
+    }
+
+    // The viewer sizes its scroll area from the first page it gets
+    char headers[80];
+    snprintf(headers, sizeof(headers), "X-Flash-Size: %lu\r\nCache-Control: no-store\r\n",
+             (unsigned long)chip);
+    conn->src.flash_addr = addr;
+    return http_stream_start(conn, "200 OK", "application/octet-stream", headers, (int32_t)len,
+                             body_flash_cached);
+}
+
+// Image upload: POST /api/flash?addr= with the raw image as the body.
+// A JOB_UPLOAD on core1 erases and programs it as it arrives; the
+// response (the finished job) goes out once it has been verified.
+static err_t handle_flash_write(http_connection_t *conn, const http_request_t *req,
+                                char *response) {
+    char num[16];
+    uint32_t addr = 0;
+    uint32_t len = req->content_length;
+    uint32_t chip = chip_size_bytes();
+
+    if (!http_request_query(req, "addr", num, sizeof(num))) {
+        send_error(conn, "400 Bad Request", "addr required");
+        return ERR_OK;
+    }
+    addr = strtoul(num, NULL, 0);
+    if (addr % FLASH_SECTOR_SIZE != 0 || len == 0) {
+        send_error(conn, "400 Bad Request", "addr must be sector aligned, body not empty");
+        return ERR_OK;
+    }
+    if (chip == 0 || addr >= chip || len > chip - addr) {
+        send_error(conn, "413 Payload Too Large", "Image does not fit the chip");
+        return ERR_OK;
+    }
+    if (!upload_open(len)) {
+        send_error(conn, "409 Conflict", "Upload already in progress");
+        return ERR_OK;
+    }
+
+    uint32_t id = jobs_submit(JOB_UPLOAD, addr, len, "");
+    if (id == 0) {
+        upload_close();
+        http_send_text(conn, "503 Service Unavailable", "application/json",
+                       "{\"error\":\"Job queue full\"}");
+        return ERR_OK;
+    }
+
+    conn->upload_job = id;
+    conn->upload_left = len;
+    if (req->body) {
+        // Small image: the parser already buffered it (ring is larger)
+        conn->upload_left -= upload_write(req->body, len);
+    }
+    return ERR_OK;
+}
+
+// Whole chip as a file download
+static err_t handle_dump(http_connection_t *conn, const http_request_t *req, char *response) {
+    return stream_flash_range(conn, req, response, 0, 0,
+                              "Content-Disposition: attachment; filename=\"dump.bin\"\r\n");
+}
+
+// View a saved report (any size, streamed from SD)
+static err_t handle_view(http_connection_t *conn, const http_request_t *req, char *response) {
+    char file[13];
+
+    // Basic safety check to prevent directory traversal
+    if (!http_request_query(req, "file", file, sizeof(file)) || !valid_file_name(file)) {
+        send_error(conn, "404 Not Found", "File not found");
+        return ERR_OK;
+    }
+
+    return stream_sd_file(conn, req, file, "application/json", NULL);
+}
+
+// ========== Route Table ==========
+// Matched against the parsed method and path (query already split off).
+// A path ending in '/' also matches anything below it.
+
+typedef struct {
+    const char *method;
+    const char *path;
+    route_handler_t handler;
+    uint8_t locks;     // BUS_* taken at admission
+    bool streams_body; // Takes bodies larger than HTTP_REQUEST_MAX
+} http_route_t;
+
+static const http_route_t http_routes[] = {
+    {"GET",  "/",             handle_index},
+    {"GET",  "/index.html",   handle_index},
+    {"GET",  "/api/status",   handle_status},
+    {"GET",  "/api/events",   handle_events},
+    {"GET",  "/api/metrics",  handle_metrics},
+    {"GET",  "/api/jedec",    handle_jedec,       BUS_SPI},
+    {"GET",  "/api/scan",     handle_scan,        BUS_SPI | BUS_SD},
+    {"GET",  "/api/download", handle_download,    BUS_SD},
+    {"GET",  "/api/publish",  handle_publish,     BUS_SD},
+    {"POST", "/api/jobs",     handle_job_submit},
+    {"GET",  "/api/jobs",     handle_job_status},
+    {"GET",  "/api/jobs/",    handle_job_status},
+    {"POST", "/api/auto",     handle_auto_control},
+    {"GET",  "/api/auto",     handle_auto_status},
+    {"GET",  "/api/view",     handle_view,        BUS_SD},
+    {"GET",  "/api/flash",    handle_flash_read,  BUS_SPI},
+    {"GET",  "/api/read",     handle_read,        BUS_SPI},
+    {"POST", "/api/flash",    handle_flash_write, BUS_SPI, true},
+    {"GET",  "/api/dump.bin", handle_dump,        BUS_SPI},
+};
+
+#define NUM_ROUTES (sizeof(http_routes) / sizeof(http_routes[0]))
+
+static bool route_path_matches(const http_route_t *route, const char *path) {
+    size_t n = strlen(route->path);
+    if (n > 1 && route->path[n - 1] == '/') {
+        return strncmp(path, route->path, n) == 0 && path[n] != '\0';
+    }
+    return strcmp(path, route->path) == 0;
+}
+
+// Bus busy at admission: ERR_INPROGRESS while the request waits for a
+// retry, otherwise it has been answered with 503
+static err_t park_request(http_connection_t *conn) {
+    uint32_t now = now_ms();
+    if (!conn->parked) {
+        int parked = 0;
+        for (int i = 0; i < MAX_HTTP_CONNECTIONS; i++) {
+            if (http_connections[i].in_use && http_connections[i].parked) parked++;
         }
-        mutex_exit(&buffer_mutex);
-
-    // 5. Publish MQTT (Fixed headers and file check)
-    } else if (strstr(request, "GET /api/publish")) {
-        if (mqtt_is_connected()) {
-            mutex_enter_blocking(&buffer_mutex);
-            
-            bool file_read = false;
-            if (sd_ready) {
-                file_read = sd_read_safe("latest.jsn", json_buffer, JSON_BUFFER_SIZE);
+        if (parked < HTTP_BUS_QUEUE) {
+            conn->parked = true;
+            conn->parked_ms = now;
+            return ERR_INPROGRESS;
+        }
+    } else if (now - conn->parked_ms < HTTP_BUS_WAIT_MS) {
+        return ERR_INPROGRESS;
+    }
+
+    conn->parked = false;
+    char retry[32];
+    snprintf(retry, sizeof(retry), "Retry-After: %d\r\n", HTTP_BUS_RETRY_AFTER_S);
+    const char *body = "{\"error\":\"Flash bus busy\"}";
+    http_send(conn, "503 Service Unavailable", "application/json", retry, body, strlen(body));
+    return ERR_OK;
+}
+
+static err_t dispatch_request(http_connection_t *conn, const http_request_t *req) {
+    const http_route_t *route = NULL;
+    bool path_known = false;
+
+    for (size_t i = 0; i < NUM_ROUTES && !route; i++) {
+        if (route_path_matches(&http_routes[i], req->path)) {
+            path_known = true;
+            if (strcmp(http_routes[i].method, req->method) == 0) {
+                route = &http_routes[i];
+                conn->route = (int8_t)i;
             }
+        }
+    }
 
-            if (file_read) {
-                mqtt_publish_report(json_buffer);
-                snprintf(response, HTML_BUFFER_SIZE, 
-                        "HTTP/1.1 200 OK\r\nContent-Type: application/json\r\n\r\n{\"message\":\"Published\"}");
-            } else {
-                snprintf(response, HTML_BUFFER_SIZE, 
-                        "HTTP/1.1 500 Internal Server Error\r\nContent-Type: application/json\r\n\r\n{\"error\":\"No report file found on SD\"}");
+    if (!route) {
+        send_error(conn, path_known ? "405 Method Not Allowed" : "404 Not Found",
+                   path_known ? "Method not allowed" : "Not found");
+        return ERR_OK;
+    }
+    if (!req->body && !route->streams_body) {
+        send_error(conn, "413 Payload Too Large", "Body too large");
+        return ERR_OK;
+    }
+    if (!bus_acquire(conn, route->locks)) {
+        return park_request(conn);
+    }
+
+    conn->parked = false;
+    err_t err = route->handler(conn, req, conn->response);
+    bus_release(route->locks);
+    return err;
+}
+
+// Pass request body bytes from pending on to the upload ring. Whatever
+// doesn't fit stays queued and unacknowledged, which shrinks the client's
+// window until core1 has programmed some more.
+static void upload_feed(http_connection_t *conn) {
+    while (conn->pending && conn->upload_left) {
+        struct pbuf *q = conn->pending;
+        size_t n = (q->len < conn->upload_left) ? q->len : conn->upload_left;
+        size_t used = upload_write(q->payload, n);
+        if (used == 0) break;
+
+        conn->pending = pbuf_free_header(q, used);
+        tcp_recved(conn->pcb, used);
+        conn->upload_left -= used;
+        conn->timestamp = now_ms();
+    }
+}
+
+// Answer the upload once its job has finished; ERR_INPROGRESS until then
+static err_t upload_respond(http_connection_t *conn) {
+    job_t job;
+    bool known = jobs_get(conn->upload_job, &job);
+    if (known && job.state != JOB_DONE && job.state != JOB_FAILED) {
+        return ERR_INPROGRESS;
+    }
+
+    conn->upload_job = 0;
+    if (!known) {
+        upload_close(); // No job left to do it
+    }
+    // Reusable only if the whole body was read (a failed job stops early)
+    conn->keep_alive = conn->upload_left == 0 && http_request_keep_alive(&conn->req) &&
+                       conn->requests < HTTP_KEEPALIVE_MAX;
+
+    size_t n = known ? jobs_format_json(&job, conn->response, HTTP_RESPONSE_MAX) : 0;
+    if (n == 0) {
+        send_error(conn, "500 Internal Server Error", "Upload job lost");
+    } else {
+        http_send(conn, job.state == JOB_DONE ? "200 OK" : "500 Internal Server Error",
+                  "application/json", NULL, conn->response, n);
+    }
+    return finish_response(conn);
+}
+
+// Parse and answer whatever is waiting in conn->pending, one request at a
+// time. Stops while a streamed response is in flight; http_sent resumes
+// once it has been queued completely.
+static err_t http_process(http_connection_t *conn) {
+    while (!conn->body) {
+        err_t err;
+        if (conn->upload_job) {
+            upload_feed(conn);
+            err = upload_respond(conn);
+            if (err == ERR_INPROGRESS) return ERR_OK;
+            if (err != ERR_OK || !conn->in_use) return err;
+            continue;
+        }
+        if (conn->parked) {
+            err = dispatch_request(conn, &conn->req); // Admission retry
+            if (err == ERR_INPROGRESS) return ERR_OK;
+            if (err != ERR_OK || !conn->in_use || conn->body) return err;
+            if (!conn->upload_job) {
+                err = finish_response(conn);
+                if (err != ERR_OK || !conn->in_use) return err;
             }
-            mutex_exit(&buffer_mutex);
-        } else {
-            snprintf(response, HTML_BUFFER_SIZE, 
-                    "HTTP/1.1 503 Service Unavailable\r\nContent-Type: application/json\r\n\r\n{\"error\":\"MQTT Not Connected\"}");
+            continue;
+        }
+        if (!conn->pending) break;
+
+        struct pbuf *q = conn->pending;
+        size_t used;
+        http_parse_status_t status = http_request_feed(&conn->req, q->payload, q->len, &used);
+        if (conn->req.len > pool_stats.request_peak) {
+            pool_stats.request_peak = conn->req.len;
         }
-        tcp_write(pcb, response, strlen(response), TCP_WRITE_FLAG_COPY);
-
-    // 6. View Report (New Handler)
-    } else if (strstr(request, "GET /api/view")) {
-        char *file_param = strstr(request, "file=");
-        bool file_found = false;
-
-        if (file_param) {
-            file_param += 5; // Skip "file="
-            char *end = strpbrk(file_param, " \r\n");
-            if (end) *end = '\0';
-            
-            // Basic safety check to prevent directory traversal
-            if (!strstr(file_param, "..") && sd_ready) {
-                mutex_enter_blocking(&buffer_mutex);
-                file_found = sd_read_safe(file_param, json_buffer, JSON_BUFFER_SIZE);
-                if (file_found) {
-                     snprintf(response, HTML_BUFFER_SIZE, "HTTP/1.1 200 OK\r\nContent-Type: application/json\r\n\r\n%s", json_buffer);
-                }
-                mutex_exit(&buffer_mutex);
+
+        conn->pending = pbuf_free_header(q, used);
+        tcp_recved(conn->pcb, used);
+
+        if (status == HTTP_PARSE_INCOMPLETE) {
+            if (used == 0) break; // Empty pbuf; wait for more
+            continue;
+        }
+        conn->route = -1;
+        conn->start_us = time_us_32();
+
+        if (status == HTTP_PARSE_DONE || status == HTTP_PARSE_BODY_STREAM) {
+            conn->requests++;
+            conn->keep_alive = http_request_keep_alive(&conn->req) &&
+                               conn->requests < HTTP_KEEPALIVE_MAX;
+            if (status == HTTP_PARSE_BODY_STREAM) {
+                // Unread body: only an upload that consumes it all keeps the connection
+                conn->keep_alive = false;
+            }
+            err = dispatch_request(conn, &conn->req);
+            if (err == ERR_INPROGRESS) {
+                return ERR_OK; // Parked; pipelined bytes stay queued behind it
+            }
+            if (err != ERR_OK || !conn->in_use || conn->body) {
+                return err; // Aborted, closed by the stream, or still streaming
+            }
+            if (conn->upload_job) {
+                continue; // Body goes to the upload, response comes later
+            }
+        } else {
+            // The byte stream can't be trusted past a framing error
+            conn->keep_alive = false;
+            if (status == HTTP_PARSE_HEADERS_TOO_LARGE) {
+                send_error(conn, "431 Request Header Fields Too Large", "Headers too large");
+            } else {
+                send_error(conn, "400 Bad Request", "Malformed request");
             }
         }
-        
-        if (!file_found) {
-            snprintf(response, HTML_BUFFER_SIZE, "HTTP/1.1 404 Not Found\r\n\r\n{\"error\":\"File not found\"}");
+
+        err = finish_response(conn);
+        if (err != ERR_OK || !conn->in_use) {
+            return err;
+        }
+    }
+    return ERR_OK;
+}
+
+// ========== Connection Callbacks ==========
+
+static err_t http_recv(void *arg, struct tcp_pcb *pcb, struct pbuf *p, err_t err) {
+    http_connection_t *conn = arg;
+
+    if (p == NULL || !conn) {
+        if (p) pbuf_free(p);
+        if (conn) {
+            return close_connection(conn);
         }
-        tcp_write(pcb, response, strlen(response), TCP_WRITE_FLAG_COPY);
+        tcp_close(pcb);
+        return ERR_OK;
     }
 
-    // ===================================================
+    conn->timestamp = now_ms();
+    if (conn->pending) {
+        pbuf_cat(conn->pending, p); // Pipelined behind a response in flight
+    } else {
+        conn->pending = p;
+    }
+    return http_process(conn);
+}
 
-    tcp_output(pcb);
-    tcp_recved(pcb, p->tot_len);
-    pbuf_free(p);
-    free(request);
-    free(response);
+static err_t http_sent(void *arg, struct tcp_pcb *pcb, u16_t len) {
+    http_connection_t *conn = arg;
+    if (!conn) return ERR_OK;
 
-    unregister_connection(pcb);
-    tcp_close(pcb);
+    conn->timestamp = now_ms();
+    if (!conn->body) return ERR_OK;
+
+    err_t err = http_pump(conn);
+    if (err != ERR_OK || !conn->in_use || conn->body) {
+        return err;
+    }
+    return http_process(conn); // Stream done: serve pipelined requests
+}
+
+// Every ~1 s: keep streams moving and drop idle or stalled connections
+static err_t http_poll(void *arg, struct tcp_pcb *pcb) {
+    http_connection_t *conn = arg;
+    if (!conn) return ERR_OK;
+
+    uint32_t limit = connection_idle(conn) ? HTTP_KEEPALIVE_TIMEOUT_MS : HTTP_STALL_TIMEOUT_MS;
+    if (now_ms() - conn->timestamp > limit) {
+        return close_connection(conn);
+    }
+
+    if (conn->body) {
+        return http_sent(arg, pcb, 0); // Backstop if a tcp_sent was missed
+    }
     return ERR_OK;
 }
 
+// lwIP already freed the pcb; just give the slot back
+static void http_err(void *arg, err_t err) {
+    http_connection_t *conn = arg;
+    if (conn) {
+        conn->pcb = NULL;
+        release_connection(conn);
+    }
+}
+
 static err_t http_accept(void *arg, struct tcp_pcb *newpcb, err_t err) {
     if (err != ERR_OK || newpcb == NULL) return ERR_VAL;
     
-    int slot = register_connection(newpcb);
-    if (slot < 0) {
+    http_connection_t *conn = register_connection(newpcb);
+    if (!conn) {
         tcp_abort(newpcb);
         return ERR_ABRT;
     }
     
-    tcp_arg(newpcb, newpcb);
+    tcp_arg(newpcb, conn);
     tcp_recv(newpcb, http_recv);
+    tcp_sent(newpcb, http_sent);
+    tcp_poll(newpcb, http_poll, 2); // ~1 s
+    tcp_err(newpcb, http_err);
+    tcp_nagle_disable(newpcb); // Small keep-alive responses shouldn't wait on ACKs
     return ERR_OK;
 }
 
+void http_server_pool_stats(http_pool_stats_t *out) {
+    *out = pool_stats; // Plain counters, only written on core0
+}
+
+bool http_server_service(void) {
+    static uint32_t seen = 0;
+    bool waiting = false;
+    uint32_t head = events_head();
+    bool new_events = (head != seen); // Heartbeats are left to http_poll
+    seen = head;
+
+    cyw43_arch_lwip_begin();
+    for (int i = 0; i < MAX_HTTP_CONNECTIONS; i++) {
+        http_connection_t *conn = &http_connections[i];
+        if (!conn->in_use) continue;
+
+        if (conn->upload_job || conn->parked) {
+            http_process(conn); // Refill the upload ring / retry bus admission
+            waiting = true;
+        } else if (conn->body && conn->bus_wait) {
+            http_sent(conn, conn->pcb, 0); // Stream stalled on the bus; serves pipelined requests after
+            waiting = true;
+        } else if (new_events && conn->body == body_events) {
+            http_pump(conn); // Only queues what the send buffer takes now
+        }
+    }
+    cyw43_arch_lwip_end();
+    return waiting;
+}
+
 void http_server_init(const char *ip_address) {
     printf("\n--- Starting HTTP Server ---\n");
     strncpy(server_ip, ip_address, sizeof(server_ip)-1);
     
     memset(http_connections, 0, sizeof(http_connections));
+    for (size_t i = 0; i < NUM_ROUTES; i++) {
+        metrics_http_route(i, http_routes[i].method, http_routes[i].path);
+    }
     // Note: Mutexes should be initialized in main.c before this is called
 
     http_server_pcb = tcp_new();
@@ -0,0 +1,124 @@
+/*
+ * Host microbenchmark: json.c hex encoder vs the old vsnprintf-per-byte path
+ *
+ * Build and run from Flash_Universal_Tool/:
+ *   gcc -O2 -Itools/json_bench/stubs -Iinclude tools/json_bench/json_bench.c \
+ *       src/json.c src/stream_sink.c src/flash_db.c -o json_bench
+ *   ./json_bench
+ *
+ * Absolute numbers are for the host CPU; the ratio is what carries over to
+ * the RP2040, where newlib's vsnprintf is relatively even more expensive.
+ */
+
+#include "json.h"
+#include "spi_ops.h"
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// ========== safeOps stand-ins (spi_ops.c needs the SDK) ==========
+
+const opcode safeOps[] = {
+    {0x9F, 1, 3, "JEDEC ID"},
+    {0x05, 1, 1, "Read Status Register 1"},
+    {0x35, 1, 1, "Read Status Register 2"},
+    {0x15, 1, 1, "Read Status Register 3"},
+    {0x90, 4, 2, "Read Mfr/Device ID (Legacy)"},
+    {0xAB, 4, 1, "Read Electronic Signature"},
+    {0x4B, 5, 8, "Read Unique ID (64-bit)"},
+    {0x5A, 5, 8, "Read SFDP Header"},
+    {0x5A, 5, 24, "Read SFDP Parameter Headers"},
+};
+#define NUM_OPS (sizeof(safeOps) / sizeof(safeOps[0]))
+
+size_t get_safe_command_count(void) { return NUM_OPS; }
+const opcode *get_command_by_index(size_t i) {
+    return i < NUM_OPS ? &safeOps[i] : NULL;
+}
+
+// ========== Reference: previous json.c implementation ==========
+
+static size_t ref_appendf(char *dst, size_t cap, size_t *idx, const char *fmt, ...) {
+    if (*idx >= cap) return 0;
+    va_list ap;
+    va_start(ap, fmt);
+    int n = vsnprintf(dst + *idx, cap - *idx, fmt, ap);
+    va_end(ap);
+    if (n < 0 || (size_t)n >= cap - *idx) {
+        *idx = cap;
+        return 0;
+    }
+    *idx += (size_t)n;
+    return (size_t)n;
+}
+
+static size_t ref_hex_array(char *dst, size_t cap, const uint8_t *buf, size_t n) {
+    size_t idx = 0;
+    ref_appendf(dst, cap, &idx, "[");
+    for (size_t i = 0; i < n; i++) {
+        ref_appendf(dst, cap, &idx, "\"%02X\"%s", buf[i], (i + 1 < n ? "," : ""));
+    }
+    ref_appendf(dst, cap, &idx, "]");
+    return idx;
+}
+
+// ========== Harness ==========
+
+static double now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static size_t new_hex_array(char *dst, size_t cap, const uint8_t *buf, size_t n) {
+    mem_sink_t mem;
+    mem_sink_init(&mem, dst, cap);
+    return json_stream_hex_array(&mem.base, buf, n) ? mem.base.written : 0;
+}
+
+int main(void) {
+    static uint8_t data[16384];
+    static char out_ref[16384 * 5 + 16], out_new[16384 * 5 + 16];
+    for (size_t i = 0; i < sizeof(data); i++) data[i] = (uint8_t)(i * 131 + 7);
+
+    // Correctness across chunk boundaries first
+    for (size_t n = 0; n <= 1500; n++) {
+        size_t a = ref_hex_array(out_ref, sizeof(out_ref), data, n);
+        size_t b = new_hex_array(out_new, sizeof(out_new), data, n);
+        if (a != b || memcmp(out_ref, out_new, a) != 0) {
+            printf("MISMATCH at n=%zu\n", n);
+            return 1;
+        }
+    }
+    printf("hex arrays identical for n = 0..1500\n\n");
+
+    static const size_t sizes[] = {64, 1024, 4096, 16384};
+    printf("%8s %14s %14s %8s\n", "bytes", "vsnprintf ns/B", "table ns/B", "speedup");
+    for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+        size_t n = sizes[s];
+        int iters = (int)(4000000 / n) + 1;
+        volatile size_t sink = 0;
+
+        double t0 = now_ns();
+        for (int i = 0; i < iters; i++) sink += ref_hex_array(out_ref, sizeof(out_ref), data, n);
+        double t1 = now_ns();
+        for (int i = 0; i < iters; i++) sink += new_hex_array(out_new, sizeof(out_new), data, n);
+        double t2 = now_ns();
+
+        double ref = (t1 - t0) / iters / n, fast = (t2 - t1) / iters / n;
+        printf("%8zu %14.2f %14.2f %7.1fx\n", n, ref, fast, ref / fast);
+    }
+
+    // Whole diagnostic report through the new writer
+    uint8_t report[64];
+    memcpy(report, data, sizeof(report));
+    int iters = 200000;
+    double t0 = now_ns();
+    size_t len = 0;
+    for (int i = 0; i < iters; i++) len = json_export_full_report(out_new, sizeof(out_new), report, 49);
+    double t1 = now_ns();
+    printf("\nfull report: %zu bytes, %.0f ns per render\n", len, (t1 - t0) / iters);
+    return 0;
+}
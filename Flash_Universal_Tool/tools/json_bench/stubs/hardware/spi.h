@@ -0,0 +1,6 @@
+// Host stand-in for the Pico SDK header so json.c builds on a PC
+#ifndef HARDWARE_SPI_H
+#define HARDWARE_SPI_H
+typedef struct spi_inst spi_inst_t;
+#define spi0 ((spi_inst_t *)0)
+#endif
@@ -0,0 +1,134 @@
+#!/usr/bin/env python3
+"""
+Rebuild chunked flash tool reports from MQTT (see mqtt_publish_file in
+src/mqtt.c).
+
+Reports up to MQTT_CHUNK_SIZE arrive whole on the report topic. Larger ones
+arrive on <topic>/chunk, one message per chunk:
+
+    {"id":7,"i":0,"n":9,"len":9000,"crc":"1A2B3C4D"}\\n<raw bytes>
+
+crc is the CRC-32 of that chunk and the last chunk also carries "sum", the
+CRC-32 of the whole report. Every complete, verified report is written to
+the output directory as <id>.json / <id>.cbor, and whole messages as
+<time>.json / <time>.cbor; a name already taken gets a -1, -2, ... suffix.
+
+Usage:
+    pip install paho-mqtt
+    python3 tools/mqtt_reassemble.py [--broker broker.hivemq.com] \\
+        [--topic sit/se33/flash/report] [--out reports]
+"""
+
+import argparse
+import json
+import os
+import sys
+import time
+import zlib
+
+import paho.mqtt.client as mqtt
+
+STALE_S = 60  # Drop a half-received report after this long without a chunk
+
+
+class Reassembler:
+    def __init__(self, out_dir):
+        self.out_dir = out_dir
+        self.partial = {}  # (topic, id) -> state
+
+    def save(self, stem, ext, data):
+        """Write <stem>.<ext>, or <stem>-1.<ext>, ... if that name is taken."""
+        os.makedirs(self.out_dir, exist_ok=True)
+        suffix = 0
+        while True:
+            name = f"{stem}.{ext}" if suffix == 0 else f"{stem}-{suffix}.{ext}"
+            path = os.path.join(self.out_dir, name)
+            try:
+                with open(path, "xb") as f:
+                    f.write(data)
+                break
+            except FileExistsError:
+                suffix += 1
+        print(f"saved {path} ({len(data)} bytes)")
+
+    def whole(self, topic, payload):
+        ext = "cbor" if topic.endswith("/cbor") else "json"
+        self.save(time.strftime("%Y%m%d-%H%M%S"), ext, payload)
+
+    def chunk(self, topic, payload):
+        nl = payload.find(b"\n")
+        if nl < 0:
+            print(f"{topic}: chunk without header, ignored", file=sys.stderr)
+            return
+        try:
+            hdr = json.loads(payload[:nl])
+            msg_id, index, count, size = hdr["id"], hdr["i"], hdr["n"], hdr["len"]
+            crc = int(hdr["crc"], 16)
+        except (ValueError, KeyError) as e:
+            print(f"{topic}: bad chunk header ({e})", file=sys.stderr)
+            return
+        data = payload[nl + 1:]
+
+        if zlib.crc32(data) != crc:
+            print(f"{topic}: id {msg_id} chunk {index} CRC mismatch", file=sys.stderr)
+            return
+
+        key = (topic, msg_id)
+        st = self.partial.setdefault(key, {"count": count, "size": size, "chunks": {}})
+        st["chunks"][index] = data
+        st["seen"] = time.monotonic()
+        if "sum" in hdr:
+            st["sum"] = int(hdr["sum"], 16)
+
+        if len(st["chunks"]) == st["count"] and "sum" in st:
+            del self.partial[key]
+            report = b"".join(st["chunks"][i] for i in range(st["count"]))
+            if len(report) != st["size"] or zlib.crc32(report) != st["sum"]:
+                print(f"{topic}: id {msg_id} failed the whole-report check", file=sys.stderr)
+                return
+            ext = "cbor" if topic.endswith("/cbor/chunk") else "json"
+            self.save(str(msg_id), ext, report)
+
+        self.expire()
+
+    def expire(self):
+        now = time.monotonic()
+        for key, st in list(self.partial.items()):
+            if now - st["seen"] > STALE_S:
+                print(f"{key[0]}: id {key[1]} incomplete, {len(st['chunks'])}/{st['count']} "
+                      "chunks", file=sys.stderr)
+                del self.partial[key]
+
+
+def main():
+    ap = argparse.ArgumentParser(description=__doc__.split("\n\n")[0])
+    ap.add_argument("--broker", default="broker.hivemq.com")
+    ap.add_argument("--port", type=int, default=1883)
+    ap.add_argument("--topic", default="sit/se33/flash/report")
+    ap.add_argument("--out", default="reports")
+    args = ap.parse_args()
+
+    r = Reassembler(args.out)
+
+    def on_connect(client, userdata, flags, rc, *extra):
+        client.subscribe(args.topic + "/#", qos=1)  # Also matches the topic itself
+        print(f"listening on {args.topic}/#")
+
+    def on_message(client, userdata, msg):
+        if msg.topic.endswith("/chunk"):
+            r.chunk(msg.topic, msg.payload)
+        else:
+            r.whole(msg.topic, msg.payload)
+
+    try:
+        client = mqtt.Client(mqtt.CallbackAPIVersion.VERSION2)
+    except AttributeError:  # paho-mqtt 1.x
+        client = mqtt.Client()
+    client.on_connect = on_connect
+    client.on_message = on_message
+    client.connect(args.broker, args.port, 60)
+    client.loop_forever()
+
+
+if __name__ == "__main__":
+    main()